@@ -5,7 +5,10 @@
     @brief    Stand-alone ESP32-S3 + PN532 (SPI) card reader.
               • No Wi-Fi / OTA
               • Bidirectional "chaser" effect with 8 LEDs: active LED in blue, inactive LEDs in dim blue
-              • Detects card by polling (SPI does not support IRQ)
+              • Detects card by polling (SPI does not support IRQ) through a
+                non-blocking PN532 state machine, so loop() never stalls audio
+              • PN532 on its own hardware SPI bus (HSPI), clock set by
+                PN532_SPI_CLOCK
               • On detection → yellow LEDs with 2 s brightness ramp
               • Then plays /success.mp3 and shows green LEDs
               • After audio finishes → returns to chaser effect
@@ -18,12 +21,20 @@
 #include <FastLED.h>
 #include <Adafruit_PN532.h>
 #include <Audio.h>
+#include <led_effects.h>
 #include "config.h"   // Pin definitions and constants (see your .h)
 
+// PN532 SPI clock for the polling frames (the chip is rated up to 5 MHz).
+// The Adafruit driver still runs its own boot-time commands at 1 MHz.
+#ifndef PN532_SPI_CLOCK
+#define PN532_SPI_CLOCK 2000000
+#endif
+
 // ---------- Global objects ----------
 CRGB leds[NUM_LEDS];
 Audio audio;
-Adafruit_PN532 nfc(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS); // ► SPI ◄
+SPIClass SPI_NFC(HSPI);                           // dedicated bus, SD keeps FSPI
+Adafruit_PN532 nfc(PN532_SS, &SPI_NFC);           // ► hardware SPI ◄
 
 // ---------- Global state ----------
 static ReaderState state = STATE_IDLE;   // enum defined in config.h
@@ -34,20 +45,49 @@ static uint8_t uid[7];
 static uint8_t uidLength;
 
 // ---------- Effect parameters ----------
-const uint16_t CHASER_INTERVAL = 120;   // ms between steps
-const CRGB     CHASER_COLOR    = CRGB::Blue;
-const uint8_t  CHASER_DIM      = 22;    // 0-255 brightness for inactive LEDs
-static int8_t  chaserIndex     = 0;
-static int8_t  chaserDir       = 1;     // 1 → forward, -1 → backward
+// Frame tables are built at compile time (led_effects.h)
+constexpr uint16_t CHASER_INTERVAL = 120;      // ms between steps
+constexpr uint32_t CHASER_COLOR    = 0x0000FF; // blue
+constexpr uint8_t  CHASER_DIM      = 22;       // 0-255 brightness for inactive LEDs
+constexpr uint16_t RAMP_MS         = 2000;
+constexpr uint16_t RAMP_FRAME_MS   = 10;
+constexpr uint32_t RAMP_COLOR      = 0xFFFF00; // yellow
+
+static constexpr fx::Chaser<NUM_LEDS, CHASER_COLOR, CHASER_DIM, CHASER_INTERVAL, MAX_BRIGHTNESS> chaserFx;
+static constexpr fx::Ramp<NUM_LEDS, RAMP_COLOR, RAMP_MS, RAMP_FRAME_MS, MIN_BRIGHTNESS, MAX_BRIGHTNESS> rampFx;
+
+// Last frame on the strip, so an unchanged frame is not sent again
+static const uint8_t *shownRgb        = nullptr;
+static uint8_t        shownBrightness = 0;
+
+// ---------- PN532 non-blocking exchange ----------
+// cardPolling() advances one step per call: send InListPassiveTarget,
+// check the status byte for the ACK / response, then read the response.
+enum NfcStage : uint8_t {
+  NFC_SEND_COMMAND,
+  NFC_WAIT_ACK,
+  NFC_WAIT_RESPONSE
+};
+static NfcStage      nfcStage      = NFC_SEND_COMMAND;
+static unsigned long nfcStageStart = 0;
+static unsigned long nfcLastCheck  = 0;
+
+const uint16_t NFC_ACK_TIMEOUT    = 20;  // ms to wait for the ACK frame
+const uint8_t  NFC_CHECK_INTERVAL = 5;   // ms between status reads
 
 // ---------- Forward declarations ----------
 void runChaserEffect();
+void showFrame(const fx::Frame &f);
 void changeState(ReaderState newState);
 void resetToIdle();
 void transitionToSuccess();
 void errorState();
 void cardPolling();
 void yellowRamp();
+bool pn532SendCommand(const uint8_t *cmd, uint8_t cmdLen);
+bool pn532IsReady();
+void pn532ReadFrame(uint8_t *buf, uint8_t len);
+int  pn532ReadResponse(uint8_t command, uint8_t *out, uint8_t maxLen);
 
 // ---------- Audio callbacks (optional) ----------
 void audio_info(const char *info) {}
@@ -75,6 +115,7 @@ void setup() {
   audio.setVolume(15);                // 0-21
 
   // --- PN532 (SPI) setup
+  SPI_NFC.begin(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
   nfc.begin();
   uint32_t version = nfc.getFirmwareVersion();
   if (!version) {
@@ -101,7 +142,7 @@ void loop() {
       break;
 
     case STATE_CARD_DETECTED:
-      yellowRamp();  // blocking 2 s ramp, then transitions to SUCCESS
+      yellowRamp();  // 2 s ramp, then transitions to SUCCESS
       break;
 
     case STATE_SUCCESS:
@@ -117,6 +158,16 @@ void loop() {
 // ===================================================================
 // ------------------   STATE FUNCTIONS   ----------------------------
 
+// Show an effect frame unless it is already on the strip
+void showFrame(const fx::Frame &f) {
+  if (f.rgb == shownRgb && f.brightness == shownBrightness) return;
+  memcpy(leds, f.rgb, sizeof(leds));
+  FastLED.setBrightness(f.brightness);
+  FastLED.show();
+  shownRgb        = f.rgb;
+  shownBrightness = f.brightness;
+}
+
 void changeState(ReaderState newState) {
   state      = newState;
   stateStart = millis();
@@ -126,12 +177,12 @@ void resetToIdle() {
   fill_solid(leds, NUM_LEDS, CRGB::Black);
   FastLED.setBrightness(MAX_BRIGHTNESS);
   FastLED.show();
-  chaserIndex = 0;
-  chaserDir   = 1;
-  changeState(STATE_IDLE);
+  shownRgb = nullptr;
+  changeState(STATE_IDLE);   // the chaser restarts from LED 0
 }
 
 void transitionToSuccess() {
+  shownRgb = nullptr;
   fill_solid(leds, NUM_LEDS, CRGB::Green);
   FastLED.show();
   audio.connecttoFS(SD, "/success.mp3");
@@ -139,6 +190,7 @@ void transitionToSuccess() {
 }
 
 void errorState() {
+  shownRgb = nullptr;
   fill_solid(leds, NUM_LEDS, CRGB::Red);
   FastLED.show();
   changeState(STATE_ERROR);
@@ -148,34 +200,13 @@ void errorState() {
 // ------------------   LED EFFECTS   -----------------------------
 
 void runChaserEffect() {
-  static unsigned long lastStep = 0;
-  if (millis() - lastStep >= CHASER_INTERVAL) {
-    // Dimmed color for inactive LEDs
-    CRGB dimColor = CHASER_COLOR;
-    dimColor.nscale8(CHASER_DIM);      // adjust brightness
-    fill_solid(leds, NUM_LEDS, dimColor);
-
-    // Active LED at full brightness
-    leds[chaserIndex] = CHASER_COLOR;
-    FastLED.show();
-
-    // Advance index and bounce at ends
-    chaserIndex += chaserDir;
-    if (chaserIndex >= NUM_LEDS - 1 || chaserIndex <= 0) {
-      chaserDir = -chaserDir;
-    }
-    lastStep = millis();
-  }
+  showFrame(chaserFx.at(millis() - stateStart));
 }
 
 void yellowRamp() {
-  const uint16_t RAMP_MS = 2000;
-  uint32_t t = millis() - stateStart;
-  if (t <= RAMP_MS) {
-    uint8_t b = map(t, 0, RAMP_MS, MIN_BRIGHTNESS, MAX_BRIGHTNESS);
-    FastLED.setBrightness(b);
-    fill_solid(leds, NUM_LEDS, CRGB::Yellow);
-    FastLED.show();
+  fx::Frame f = rampFx.at(millis() - stateStart);
+  if (f.holdMs > 0) {
+    showFrame(f);
   } else {
     FastLED.setBrightness(MAX_BRIGHTNESS);
     transitionToSuccess();
@@ -186,9 +217,133 @@ void yellowRamp() {
 // ------------------   NFC / CARDS   -----------------------------
 
 void cardPolling() {
-  uint8_t success = nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength, 50); // timeout 50 ms
-  if (success) {
-    Serial.print(F("[CARD] UID length=")); Serial.println(uidLength);
-    changeState(STATE_CARD_DETECTED);
+  // Status reads are cheap but not free: space them out
+  if (nfcStage != NFC_SEND_COMMAND && millis() - nfcLastCheck < NFC_CHECK_INTERVAL) return;
+  nfcLastCheck = millis();
+
+  switch (nfcStage) {
+    case NFC_SEND_COMMAND: {
+      // InListPassiveTarget, 1 target, 106 kbps type A. The PN532 keeps
+      // searching until a card shows up, so it is only sent once per card.
+      const uint8_t cmd[] = { PN532_COMMAND_INLISTPASSIVETARGET, 1, PN532_MIFARE_ISO14443A };
+      if (pn532SendCommand(cmd, sizeof(cmd))) {
+        nfcStage      = NFC_WAIT_ACK;
+        nfcStageStart = millis();
+      }
+      break;
+    }
+
+    case NFC_WAIT_ACK: {
+      if (!pn532IsReady()) {
+        if (millis() - nfcStageStart > NFC_ACK_TIMEOUT) nfcStage = NFC_SEND_COMMAND;
+        break;
+      }
+      static const uint8_t ACK[] = { 0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00 };
+      uint8_t ack[sizeof(ACK)];
+      pn532ReadFrame(ack, sizeof(ack));
+      nfcStage = memcmp(ack, ACK, sizeof(ACK)) == 0 ? NFC_WAIT_RESPONSE : NFC_SEND_COMMAND;
+      break;
+    }
+
+    case NFC_WAIT_RESPONSE: {
+      if (!pn532IsReady()) break;   // no card yet
+
+      // NbTg Tg SENS_RES(2) SEL_RES IDLen ID...
+      uint8_t resp[32];
+      int n = pn532ReadResponse(PN532_COMMAND_INLISTPASSIVETARGET, resp, sizeof(resp));
+      nfcStage = NFC_SEND_COMMAND;
+
+      if (n < 6 || resp[0] != 1 || resp[5] > sizeof(uid) || 6 + resp[5] > n) break;
+
+      uidLength = resp[5];
+      memcpy(uid, &resp[6], uidLength);
+      Serial.print(F("[CARD] UID length=")); Serial.println(uidLength);
+      changeState(STATE_CARD_DETECTED);
+      break;
+    }
   }
 }
+
+// ===================================================================
+// ------------------   PN532 SPI FRAMES   ---------------------------
+// Minimal frame layer on the PN532's hardware SPI bus, so a single
+// exchange can be split across several loop() calls. Every frame goes
+// out as one FIFO burst inside its own bus transaction.
+
+static const SPISettings PN532_SPI_SETTINGS(PN532_SPI_CLOCK, LSBFIRST, SPI_MODE0);
+
+static void pn532Select() {
+  SPI_NFC.beginTransaction(PN532_SPI_SETTINGS);
+  digitalWrite(PN532_SS, LOW);
+}
+
+static void pn532Deselect() {
+  digitalWrite(PN532_SS, HIGH);
+  SPI_NFC.endTransaction();
+}
+
+bool pn532SendCommand(const uint8_t *cmd, uint8_t cmdLen) {
+  if (cmdLen > 32) return false;
+
+  uint8_t len = cmdLen + 1;                        // + TFI
+  uint8_t sum = PN532_HOSTTOPN532;
+  for (uint8_t i = 0; i < cmdLen; i++) sum += cmd[i];
+
+  uint8_t frame[32 + 10];
+  uint8_t n = 0;
+  frame[n++] = PN532_SPI_DATAWRITE;
+  frame[n++] = PN532_PREAMBLE;
+  frame[n++] = PN532_STARTCODE1;
+  frame[n++] = PN532_STARTCODE2;
+  frame[n++] = len;
+  frame[n++] = ~len + 1;                           // LCS
+  frame[n++] = PN532_HOSTTOPN532;
+  memcpy(&frame[n], cmd, cmdLen);
+  n += cmdLen;
+  frame[n++] = ~sum + 1;                           // DCS
+  frame[n++] = PN532_POSTAMBLE;
+
+  pn532Select();
+  SPI_NFC.writeBytes(frame, n);
+  pn532Deselect();
+  return true;
+}
+
+bool pn532IsReady() {
+  pn532Select();
+  SPI_NFC.transfer(PN532_SPI_STATREAD);
+  uint8_t status = SPI_NFC.transfer(0x00);
+  pn532Deselect();
+  return status == PN532_SPI_READY;
+}
+
+void pn532ReadFrame(uint8_t *buf, uint8_t len) {
+  pn532Select();
+  SPI_NFC.transfer(PN532_SPI_DATAREAD);
+  memset(buf, 0x00, len);
+  SPI_NFC.transfer(buf, len);                      // clocks out zeros, reads in place
+  pn532Deselect();
+}
+
+// Read a response frame and check it before trusting any of it: start
+// code, LEN + LCS == 0, direction and command code, data checksum.
+// Copies the data after the command code (at most maxLen bytes) into out
+// and returns how many it holds, or -1 for a bad frame.
+int pn532ReadResponse(uint8_t command, uint8_t *out, uint8_t maxLen) {
+  // 00 00 FF LEN LCS D5 CMD+1 data... DCS 00, read in one burst
+  uint8_t frame[64];
+  pn532ReadFrame(frame, sizeof(frame));
+
+  uint8_t len = frame[3];
+  if (frame[0] != PN532_PREAMBLE || frame[1] != PN532_STARTCODE1 || frame[2] != PN532_STARTCODE2) return -1;
+  if ((uint8_t)(len + frame[4]) != 0 || len < 2 || len >= sizeof(frame) - 5) return -1;
+  if (frame[5] != PN532_PN532TOHOST || frame[6] != (uint8_t)(command + 1)) return -1;
+
+  uint8_t sum = 0;
+  for (uint8_t i = 5; i <= 5 + len; i++) sum += frame[i];   // TFI .. DCS
+  if (sum != 0) return -1;
+
+  uint8_t n = min<uint8_t>(len - 2, maxLen);
+  memcpy(out, &frame[7], n);
+  return n;
+}
@@ -0,0 +1,166 @@
+/**************************************************************************/
+/*!
+    @file     bench_main.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    PN532 throughput / SPI timing benchmark (pio run -e bench).
+              - getFirmwareVersion / readPassiveTargetID through the
+                Adafruit driver on the hardware SPI_NFC(HSPI) bus (02 path)
+                for several poll timeouts
+              - Raw GetFirmwareVersion / InListPassiveTarget frames on the
+                same bus across SPI clock speeds
+              - Same driver calls with the bit-banged constructor (01 path)
+              - Prints reads/s, failure rate and p50 / p99 / max latency;
+                send 'r' on the serial monitor to run again
+              Leave a card on the reader for the read tests, or remove it
+              to measure the empty-field cost.
+*/
+/**************************************************************************/
+
+#include <Arduino.h>
+#include <SPI.h>
+#include <Adafruit_PN532.h>
+#include <esp_timer.h>
+#include "config.h"
+#include "pn532_link.h"
+
+// ======================= GLOBAL OBJECTS ==========================
+SPIClass SPI_NFC(HSPI);
+Adafruit_PN532 nfcHw(PN532_SS, &SPI_NFC);                            // 02 path
+Adafruit_PN532 nfcSoft(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS); // 01 path
+Pn532Link nfcLink(SPI_NFC, PN532_SS);
+
+// ======================= PARAMETERS ==========================
+static constexpr uint16_t ITERATIONS = 200;
+static constexpr uint32_t RAW_TIMEOUT_MS = 50;
+static const uint16_t POLL_TIMEOUTS_MS[] = {10, 25, 50, 100};
+static const uint32_t SPI_CLOCKS_HZ[] = {500000, 1000000, 2000000, 3000000, 4000000, 5000000};
+
+static uint32_t samples[ITERATIONS];
+
+// ======================= HELPERS ==========================
+static void sortSamples(uint16_t n)
+{
+    for (uint16_t i = 1; i < n; i++)
+    {
+        uint32_t x = samples[i];
+        uint16_t j = i;
+        for (; j > 0 && samples[j - 1] > x; j--)
+        {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = x;
+    }
+}
+
+// Run `fn` ITERATIONS times and print one result row
+template <typename F>
+static void runCase(const char *path, const char *op, uint32_t param, F fn)
+{
+    uint16_t ok = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint16_t i = 0; i < ITERATIONS; i++)
+    {
+        int64_t t0 = esp_timer_get_time();
+        if (fn())
+        {
+            ok++;
+        }
+        samples[i] = (uint32_t)(esp_timer_get_time() - t0);
+    }
+    float seconds = (esp_timer_get_time() - start) / 1e6f;
+
+    sortSamples(ITERATIONS);
+    Serial.printf("%-8s %-20s %8u %8.1f %6.1f %8u %8u %8u\n", path, op, (unsigned)param,
+                  ITERATIONS / seconds, 100.0f * (ITERATIONS - ok) / ITERATIONS,
+                  (unsigned)samples[(ITERATIONS - 1) / 2],
+                  (unsigned)samples[(ITERATIONS * 99 - 1) / 100],
+                  (unsigned)samples[ITERATIONS - 1]);
+}
+
+static bool readUid(Adafruit_PN532 &nfc, uint16_t timeoutMs)
+{
+    uint8_t uid[7];
+    uint8_t uidLength = 0;
+    return nfc.readPassiveTargetID(PN532_MIFARE_ISO14443A, uid, &uidLength, timeoutMs);
+}
+
+// ======================= SUITE ==========================
+static void runSuite()
+{
+    Serial.println();
+    Serial.println(F("path     op                      param    ops/s  fail%    p50us    p99us    maxus"));
+
+    // ----- 02: hardware SPI through the Adafruit driver (1 MHz, fixed by the driver) -----
+    SPI_NFC.begin(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
+    nfcHw.begin();
+    if (!nfcHw.getFirmwareVersion())
+    {
+        Serial.println(F("[BENCH] PN532 not found on SPI_NFC"));
+        return;
+    }
+    nfcHw.SAMConfig();
+
+    runCase("hw-lib", "getFirmwareVersion", 1000000, []() { return nfcHw.getFirmwareVersion() != 0; });
+    for (uint16_t t : POLL_TIMEOUTS_MS)
+    {
+        runCase("hw-lib", "readPassiveTargetID", t, [t]() {
+            bool ok = readUid(nfcHw, t);
+            if (!ok)
+            {
+                nfcLink.abort(); // drop the still-pending InListPassiveTarget
+            }
+            return ok;
+        });
+    }
+
+    // ----- Raw frames on the same bus, per SPI clock -----
+    for (uint32_t hz : SPI_CLOCKS_HZ)
+    {
+        nfcLink.setClock(hz);
+        runCase("hw-raw", "GetFirmwareVersion", hz, []() {
+            const uint8_t cmd[] = {PN532_COMMAND_GETFIRMWAREVERSION};
+            uint8_t resp[4];
+            return nfcLink.transceive(cmd, sizeof(cmd), resp, sizeof(resp), RAW_TIMEOUT_MS) == 4;
+        });
+        runCase("hw-raw", "InListPassiveTarget", hz, []() {
+            const uint8_t cmd[] = {PN532_COMMAND_INLISTPASSIVETARGET, 1, PN532_MIFARE_ISO14443A};
+            uint8_t resp[20];
+            return nfcLink.transceive(cmd, sizeof(cmd), resp, sizeof(resp), RAW_TIMEOUT_MS) > 0 && resp[0] == 1;
+        });
+    }
+
+    // ----- 01: bit-banged constructor on the same pins -----
+    SPI_NFC.end();
+    nfcSoft.begin();
+    if (!nfcSoft.getFirmwareVersion())
+    {
+        Serial.println(F("[BENCH] PN532 not found on bit-banged pins"));
+        return;
+    }
+    nfcSoft.SAMConfig();
+
+    runCase("soft", "getFirmwareVersion", 0, []() { return nfcSoft.getFirmwareVersion() != 0; });
+    for (uint16_t t : POLL_TIMEOUTS_MS)
+    {
+        runCase("soft", "readPassiveTargetID", t, [t]() { return readUid(nfcSoft, t); });
+    }
+
+    Serial.println(F("[BENCH] done, send 'r' to run again"));
+}
+
+// ======================= SETUP/LOOP ==========================
+void setup()
+{
+    Serial.begin(115200);
+    delay(1500); // let the USB CDC monitor attach
+    runSuite();
+}
+
+void loop()
+{
+    if (Serial.available() && Serial.read() == 'r')
+    {
+        runSuite();
+    }
+    delay(20);
+}
@@ -0,0 +1,43 @@
+/**************************************************************************/
+/*!
+    @file     allowlist.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    On-device UID allowlist.
+              - Open-addressing hash table of 4/7-byte UIDs stored in the
+                "uidlist" flash partition (see partitions_16mb_littlefs.csv)
+              - The partition is memory-mapped, nothing is copied to heap
+              - Lookup is one FNV-1a hash plus a short linear probe
+              - Image is built on the host with tools/build_uidlist.py
+*/
+/**************************************************************************/
+
+#ifndef ALLOWLIST_H
+#define ALLOWLIST_H
+
+#include <Arduino.h>
+
+// Image layout (little endian):
+//   AllowlistHeader, then slotCount slots of ALLOWLIST_SLOT_SIZE bytes:
+//   [uid length][uid, zero padded to 7 bytes]; length 0 -> empty slot
+static constexpr uint32_t ALLOWLIST_MAGIC = 0x4C444955; // "UIDL"
+static constexpr uint16_t ALLOWLIST_VERSION = 1;
+static constexpr uint16_t ALLOWLIST_SLOT_SIZE = 8;
+
+struct AllowlistHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slotSize;
+    uint32_t slotCount; // power of two
+    uint32_t entryCount;
+};
+
+// Map the partition and validate the image
+bool allowlistBegin();
+
+bool allowlistLoaded();
+uint32_t allowlistSize();
+
+bool allowlistContains(const uint8_t *uid, uint8_t uidLength);
+
+#endif // ALLOWLIST_H
@@ -0,0 +1,52 @@
+/**************************************************************************/
+/*!
+    @file     card_data.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Card data stage: reads what is stored on the card, in the
+              same RF session as the UID (the target stays selected).
+              - Ultralight / NTAG: 4-page READs, only as many as the NDEF
+                message needs; the first record is parsed (Text / URI)
+              - MIFARE Classic: one authentication per sector, then its
+                three data blocks; the key that opened each sector last
+                time is tried first, so a fleet of cards sharing keys
+                needs a single authentication
+              - Raw InDataExchange frames over Pn532Link, no per-call
+                delays of the Adafruit helpers
+              - Addresses the card by its PN532 target number, so either
+                card of a two-target listing (nfc_targets.h) can be read
+*/
+/**************************************************************************/
+
+#ifndef CARD_DATA_H
+#define CARD_DATA_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "pn532_link.h"
+#include "nfc_targets.h"
+#include "card_record.h"
+
+class CardReader
+{
+public:
+    explicit CardReader(Pn532Link &pn532) : link(pn532) {}
+
+    // Read the data of a card from the last listing. Returns false
+    // (out.kind == CARD_DATA_NONE) if it holds nothing readable.
+    bool read(const NfcTarget &target, CardRecord &out);
+
+private:
+    static constexpr uint8_t CLASSIC_SECTORS = 16;
+
+    int exchange(const uint8_t *cmd, uint8_t cmdLen, uint8_t *out, uint8_t maxLen);
+    bool reselect(const uint8_t *uid, uint8_t uidLength);
+    bool readUltralight(CardRecord &out);
+    bool readClassic(const uint8_t *uid, CardRecord &out);
+    bool authenticate(const uint8_t *uid, uint8_t sector);
+
+    Pn532Link &link;
+    uint8_t tg = 1; // target being read
+    uint8_t keyHint[CLASSIC_SECTORS] = {}; // index of the key that worked last
+};
+
+#endif // CARD_DATA_H
@@ -0,0 +1,40 @@
+/**************************************************************************/
+/*!
+    @file     card_record.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    What a tap carries besides the UID, and the NDEF decoding
+              that fills it.
+              - No PN532 / SPI dependency: the parser also builds on the
+                host, where test/test_ndef feeds it malformed messages
+                (pio test -e test)
+*/
+/**************************************************************************/
+
+#ifndef CARD_RECORD_H
+#define CARD_RECORD_H
+
+#include <Arduino.h>
+
+typedef enum : uint8_t
+{
+    CARD_DATA_NONE,
+    CARD_DATA_NDEF_TEXT,   // data = text, language code stripped
+    CARD_DATA_NDEF_URI,    // data = URI, prefix code expanded
+    CARD_DATA_NDEF_OTHER,  // data = payload of the first record
+    CARD_DATA_CLASSIC      // data = the 48 data bytes of CARD_CLASSIC_SECTOR
+} CardDataKind;
+
+static constexpr uint8_t CARD_RECORD_MAX = 48;
+
+struct CardRecord
+{
+    CardDataKind kind;
+    uint8_t length;
+    uint8_t data[CARD_RECORD_MAX];
+};
+
+// Decode the first record of an NDEF message. `msg` is untrusted card
+// memory: false for a truncated record or one whose lengths overrun `len`.
+bool ndefParseFirstRecord(const uint8_t *msg, uint16_t len, CardRecord &out);
+
+#endif // CARD_RECORD_H
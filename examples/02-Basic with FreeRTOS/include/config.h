@@ -9,7 +9,129 @@
 #define PN532_MISO     12
 #define PN532_SS       15
 #define PN532_IRQ      21
-#define PN532_RESET     3
+#define PN532_RESET     3   // RSTPDN, -1 if not wired
+
+// Card detection mode:
+//   1 -> arm InListPassiveTarget and sleep until the PN532 pulls IRQ low
+//   0 -> poll a blocking InListPassiveTarget with a timeout
+#ifndef NFC_USE_IRQ
+#define NFC_USE_IRQ     1
+#endif
+
+// Re-arm the pending InListPassiveTarget if no IRQ arrives in this time (ms)
+#ifndef NFC_IRQ_REARM_MS
+#define NFC_IRQ_REARM_MS 10000
+#endif
+
+// PN532 health (nfc_health.h): NFC_FAULT_LIMIT failed exchanges in a row
+// hard-reset the PN532; a recovery that fails is retried every
+// NFC_RECOVERY_RETRY_MS with the reader shown in error meanwhile
+#ifndef NFC_FAULT_LIMIT
+#define NFC_FAULT_LIMIT 2
+#endif
+#ifndef NFC_RECOVERY_RETRY_MS
+#define NFC_RECOVERY_RETRY_MS 1000
+#endif
+// Subscribe the NFC task to the system task watchdog (its timeout and
+// panic setting, CONFIG_ESP_TASK_WDT_*, stay as the core configured them);
+// 0 -> off
+#ifndef NFC_WATCHDOG
+#define NFC_WATCHDOG    1
+#endif
+// > 0: re-initialise the system task watchdog at boot with this timeout
+// (s) and panic on expiry, so a stuck NFC loop reboots the board. This is
+// global: it applies to every subscribed task, the idle tasks included.
+#ifndef TASK_WDT_TIMEOUT_S
+#define TASK_WDT_TIMEOUT_S 0
+#endif
+
+// Cards listed per scan (1 or 2). With 2, badges presented together (a
+// wallet) come back in the same InListPassiveTarget and the allowlist picks
+// the valid one, instead of colliding and retrying.
+#ifndef NFC_MAX_TARGETS
+#define NFC_MAX_TARGETS 1
+#endif
+
+// Adaptive polling (see nfc_power.h): after NFC_ACTIVE_HOLD_MS without a
+// card, scan with NFC_SCAN_RETRIES activation attempts and power the PN532
+// down in between; the gap starts at NFC_POLL_SLOW_MS and doubles every
+// NFC_BACKOFF_STEP_MS of idle time up to NFC_POLL_MAX_MS
+#ifndef NFC_ADAPTIVE_POLL
+#define NFC_ADAPTIVE_POLL   0
+#endif
+#ifndef NFC_ACTIVE_HOLD_MS
+#define NFC_ACTIVE_HOLD_MS  30000
+#endif
+#ifndef NFC_POLL_SLOW_MS
+#define NFC_POLL_SLOW_MS    150
+#endif
+#ifndef NFC_POLL_MAX_MS
+#define NFC_POLL_MAX_MS     600
+#endif
+#ifndef NFC_BACKOFF_STEP_MS
+#define NFC_BACKOFF_STEP_MS 60000
+#endif
+#ifndef NFC_SCAN_RETRIES
+#define NFC_SCAN_RETRIES    2
+#endif
+// Let an external RF field (phone, another reader) wake the PN532
+#ifndef NFC_WAKE_ON_FIELD
+#define NFC_WAKE_ON_FIELD   1
+#endif
+
+// Pipelined reads: keep polling in every state and queue accepted UIDs
+// instead of ignoring the reader until the feedback cycle is over
+#ifndef NFC_PIPELINED
+#define NFC_PIPELINED   1
+#endif
+
+// A UID seen again within this window (ms) is ignored; the window restarts
+// on every read, so a card left on the reader never re-triggers
+#ifndef UID_DEDUP_MS
+#define UID_DEDUP_MS    1500
+#endif
+
+// Built-in feedback timeline: 0 -> 2 s ramp + wait for the clip, 1 ->
+// "fast lane" (short ramp, brief green, clip keeps playing while the next
+// card is read). Used until / unless a timeline file is loaded.
+#ifndef FEEDBACK_FAST_LANE
+#define FEEDBACK_FAST_LANE 0
+#endif
+
+// Feedback timeline file (tools/build_timeline.py) on LittleFS, loaded at
+// boot; a copy at the same path on the SD card is installed over it first
+#ifndef FEEDBACK_TIMELINE_PATH
+#define FEEDBACK_TIMELINE_PATH "/feedback.tl"
+#endif
+
+// Keyframes a timeline may hold, all tracks together (8 bytes each)
+#ifndef FEEDBACK_MAX_KEYFRAMES
+#define FEEDBACK_MAX_KEYFRAMES 32
+#endif
+
+// ===================== Card data =====================
+// Read the card's stored data after the UID (card_data.h)
+#ifndef CARD_DATA
+#define CARD_DATA       1
+#endif
+
+// MIFARE Classic sector holding the credential (its 3 data blocks)
+#ifndef CARD_CLASSIC_SECTOR
+#define CARD_CLASSIC_SECTOR 1
+#endif
+
+// 1 -> deny cards whose data could not be read. Only the first card of a
+// two-card scan (NFC_MAX_TARGETS) is read, a second one never has data.
+#ifndef CARD_DATA_REQUIRED
+#define CARD_DATA_REQUIRED 0
+#endif
+
+// ===================== Authorization =====================
+// Behaviour when the uidlist partition holds no valid allowlist:
+//   0 -> accept every card, 1 -> deny every card
+#ifndef ALLOWLIST_REQUIRED
+#define ALLOWLIST_REQUIRED 0
+#endif
 
 // ===================== SD (SPI) =====================
 #define SD_CS           5
@@ -17,11 +139,38 @@
 #define SPI_MISO        8
 #define SPI_SCK        18
 
+// 1 -> PN532 on the SD bus above (own CS, PN532_SS); its SCK/MISO/MOSI pins
+//      are then unused. SpiBus keeps PN532 frames ahead of SD streaming;
+//      pair it with NFC_USE_IRQ so a scan does not hold the bus while it waits
+#ifndef NFC_SHARED_SPI_BUS
+#define NFC_SHARED_SPI_BUS 0
+#endif
+
+// SD read-ahead for the decoder fallback (needs PSRAM): a background task
+// fills a ring with AUDIO_READAHEAD_CHUNK_KB reads, audio.loop() reads
+// from memory. On a shared bus one chunk is also the longest a PN532
+// frame can wait (32 KB is ~12 ms at 25 MHz).
+#ifndef AUDIO_READAHEAD
+#define AUDIO_READAHEAD 1
+#endif
+#ifndef AUDIO_READAHEAD_KB
+#define AUDIO_READAHEAD_KB 256
+#endif
+#ifndef AUDIO_READAHEAD_CHUNK_KB
+#define AUDIO_READAHEAD_CHUNK_KB 32
+#endif
+
 // ===================== I2S Audio =====================
 #define I2S_DOUT       40
 #define I2S_BCLK       41
 #define I2S_LRC        42
 
+// Fade-in at clip start (ms): per-sample gain ramp on cached PCM, volume
+// steps between decoder passes on the SD fallback
+#ifndef AUDIO_FADE_MS
+#define AUDIO_FADE_MS 100
+#endif
+
 // ===================== LED Strip =====================
 #define LED_PIN        16
 #define NUM_LEDS        8
@@ -29,11 +178,100 @@
 #define MIN_BRIGHTNESS  2
 #define MAX_BRIGHTNESS 65
 
+// Frame rate cap for the LED renderer; unchanged frames are never sent
+#ifndef LED_TARGET_FPS
+#define LED_TARGET_FPS 100
+#endif
+
+// LED output backend:
+//   1 -> double-buffered frames handed to the RMT peripheral, show() returns
+//        as soon as the transfer is queued
+//   0 -> FastLED.show() (blocks until the frame is on the wire)
+#ifndef LED_OUTPUT_ASYNC_RMT
+#define LED_OUTPUT_ASYNC_RMT 1
+#endif
+#define LED_RMT_CHANNEL RMT_CHANNEL_0
+
+// ===================== Tap log =====================
+// Audit trail of every accepted tap on LittleFS, see tap_log.h
+#ifndef TAP_LOG
+#define TAP_LOG         1
+#endif
+
+// Flush interval (ms) when fewer than a page of records is waiting
+#ifndef TAP_LOG_FLUSH_MS
+#define TAP_LOG_FLUSH_MS 5000
+#endif
+
+// Rotation: file size (KB) and number of files kept
+#ifndef TAP_LOG_FILE_KB
+#define TAP_LOG_FILE_KB 64
+#endif
+#ifndef TAP_LOG_FILES
+#define TAP_LOG_FILES   4
+#endif
+
+// ===================== Host link =====================
+// Binary tap frames for the access controller, see host_link.h:
+//   0 -> off, 1 -> UART on HOST_UART_TX / RX (RS-485 transceiver optional),
+//   2 -> USB CDC, interleaved with the console (the [CARD] text line is
+//        then left out so a tap never waits on the console)
+#ifndef HOST_LINK
+#define HOST_LINK       0
+#endif
+#define HOST_UART_TX    43
+#define HOST_UART_RX    44
+#ifndef HOST_LINK_BAUD
+#define HOST_LINK_BAUD  921600
+#endif
+// Serial driver TX ring: frames that can wait for the wire (32 bytes each)
+#ifndef HOST_LINK_TX_BUF
+#define HOST_LINK_TX_BUF 1024
+#endif
+
+// ===================== Diagnostics =====================
+// Per-tap stage timestamps, printed by the "lat" serial command
+#ifndef LATENCY_TRACE
+#define LATENCY_TRACE   1
+#endif
+
+// ===================== Metrics =====================
+// Line-protocol metrics on the USB CDC console every METRICS_PERIOD_MS;
+// 0 -> off until "metrics <ms>" on the console. The per-task cpu field
+// needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS in the IDF config and is
+// left out without it.
+#ifndef METRICS_PERIOD_MS
+#define METRICS_PERIOD_MS 0
+#endif
+
+// ===================== Memory =====================
+// 1 -> no heap use after boot: task stacks and event queues in .bss,
+// static semaphores, PSRAM buffers carved from one PSRAM_ARENA_KB arena
+// reserved at boot (see static_alloc.h)
+#ifndef STATIC_ALLOC
+#define STATIC_ALLOC    0
+#endif
+// Holds the resident clips and the SD read-ahead ring
+#ifndef PSRAM_ARENA_KB
+#define PSRAM_ARENA_KB  2048
+#endif
+
+// ===================== Tasks =====================
+// Task layout, see task_profile.cpp:
+//   0 -> balanced: LED + NFC on core 0, audio + authorization on core 1
+//   1 -> latency: NFC alone on core 1 above LED and audio
+//   2 -> pipeline: RF acquire + log on core 0, authorize + LED + audio
+//        on core 1
+#ifndef TASK_PROFILE
+#define TASK_PROFILE    2
+#endif
+
 // ===================== Reader state =====================
 typedef enum {
     STATE_IDLE,
     STATE_CARD_DETECTED,
     STATE_SUCCESS,
+    STATE_DENIED,
     STATE_ERROR
 } ReaderState;
 
@@ -0,0 +1,68 @@
+/**************************************************************************/
+/*!
+    @file     event_bus.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Typed inter-task events for the reader.
+              - One FreeRTOS queue per consumer task (LED, Audio)
+              - Each event carries its kind, the card UID and a timestamp
+              - Consumers block on their queue until an event arrives or
+                their next animation / service deadline expires
+*/
+/**************************************************************************/
+
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <Arduino.h>
+#include "card_data.h"
+
+// ======================= EVENTS ==========================
+typedef enum : uint8_t
+{
+    EVT_CARD_DETECTED, // NFC -> LED
+    EVT_PLAY_SOUND,    // LED -> Audio
+    EVT_AUDIO_DONE,    // Audio -> LED
+    EVT_READER_FAULT,  // NFC -> LED, PN532 not answering
+    EVT_READER_OK,     // NFC -> LED, PN532 back after a fault
+    EVT_TIMELINE_LOADED // Storage -> LED, feedback timeline file ready
+} ReaderEventKind;
+
+typedef enum : uint8_t
+{
+    EVT_TO_LED,
+    EVT_TO_AUDIO,
+    EVT_TARGET_COUNT
+} EventTarget;
+
+typedef enum : uint8_t
+{
+    RESULT_GRANTED,
+    RESULT_DENIED
+} AccessResult;
+
+struct ReaderEvent
+{
+    ReaderEventKind kind;
+    AccessResult result; // EVT_CARD_DETECTED only
+    uint8_t sound;       // SoundId, EVT_PLAY_SOUND / EVT_AUDIO_DONE only
+    uint8_t uidLength;
+    uint8_t uid[7];
+    uint16_t tapId;      // latency trace id, 0 -> none (latency_trace.h)
+    CardRecord card;     // EVT_CARD_DETECTED only, data read from the card
+    int64_t timestampUs; // esp_timer_get_time() when the event was raised
+};
+
+// Create the queues; call before any task that uses them starts
+bool eventBusBegin();
+
+// Post without blocking; returns false if the consumer queue is full
+bool eventPost(EventTarget to, const ReaderEvent &ev);
+bool eventPost(EventTarget to, ReaderEventKind kind, uint16_t tapId = 0);
+
+// Block up to `timeout` ticks for the next event addressed to `self`
+bool eventWait(EventTarget self, ReaderEvent &ev, TickType_t timeout);
+
+// Events waiting in a consumer queue (metrics)
+uint8_t eventPending(EventTarget to);
+
+#endif // EVENT_BUS_H
@@ -0,0 +1,114 @@
+/**************************************************************************/
+/*!
+    @file     feedback_timeline.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Tap feedback as data: keyframe tracks instead of constants.
+              - One track per feedback state (card detected, granted,
+                denied); each keyframe is a solid colour at a brightness,
+                an optional clip cue and a duration
+              - Compact binary file built by tools/build_timeline.py,
+                loaded from LittleFS at boot (FEEDBACK_TIMELINE_PATH);
+                the built-in timeline below is used until then
+              - Validated once when loaded: ReaderFsm indexes the
+                keyframes directly, nothing is parsed per frame and
+                nothing is allocated
+*/
+/**************************************************************************/
+
+#ifndef FEEDBACK_TIMELINE_H
+#define FEEDBACK_TIMELINE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "sound_id.h"
+
+// ======================= FILE FORMAT ==========================
+// Little-endian: FeedbackFileHeader, then the keyframes of every track,
+// track by track (FeedbackKeyframe each). Must match the tool.
+static constexpr uint32_t FEEDBACK_MAGIC = 0x4C544246; // "FBTL"
+static constexpr uint8_t FEEDBACK_VERSION = 1;
+
+typedef enum : uint8_t
+{
+    TRACK_DETECTED, // CARD_DETECTED, then SUCCESS when it ends
+    TRACK_GRANTED,  // SUCCESS, then the next tap / IDLE
+    TRACK_DENIED,   // DENIED, then the next tap / IDLE
+    TRACK_COUNT
+} FeedbackTrack;
+
+// Keyframe flags
+static constexpr uint8_t KF_FADE = 0x01;       // gamma fade from the previous keyframe's level
+static constexpr uint8_t KF_WAIT_AUDIO = 0x02; // ends with its cue (durationMs if it can't play)
+
+static constexpr uint8_t FEEDBACK_NO_CUE = 0xFF;
+
+// Default chaser step; the idle effect table is built for it
+static constexpr uint16_t CHASER_INTERVAL_MS = 120;
+
+struct __attribute__((packed)) FeedbackFileHeader
+{
+    uint32_t magic;
+    uint8_t version;
+    uint8_t trackLength[TRACK_COUNT]; // keyframes per track
+    uint16_t idleStepMs;              // IDLE chaser step
+    uint16_t reserved;
+};
+
+struct __attribute__((packed)) FeedbackKeyframe
+{
+    uint8_t rgb[3];
+    uint8_t brightness; // capped at MAX_BRIGHTNESS when loaded
+    uint8_t cue;        // SoundId played on entry, FEEDBACK_NO_CUE -> none
+    uint8_t flags;      // KF_*
+    uint16_t durationMs;
+};
+
+static_assert(FEEDBACK_MAX_KEYFRAMES <= 255, "keyframe indices are 8 bit");
+static_assert(sizeof(FeedbackFileHeader) == 12, "timeline header layout");
+static_assert(sizeof(FeedbackKeyframe) == 8, "timeline keyframe layout");
+
+// ======================= TIMELINE ==========================
+struct FeedbackTimeline
+{
+    uint16_t idleStepMs;
+    uint8_t first[TRACK_COUNT];
+    uint8_t length[TRACK_COUNT];
+    FeedbackKeyframe keys[FEEDBACK_MAX_KEYFRAMES];
+};
+
+static constexpr size_t FEEDBACK_FILE_MAX =
+    sizeof(FeedbackFileHeader) + FEEDBACK_MAX_KEYFRAMES * sizeof(FeedbackKeyframe);
+
+// Built-in feedback: the 2 s ramp and clip wait, or the short "fast lane"
+// (FEEDBACK_FAST_LANE). A first keyframe of 0 ms sets where a fade starts.
+#if FEEDBACK_FAST_LANE
+static constexpr FeedbackTimeline FEEDBACK_BUILTIN = {
+    CHASER_INTERVAL_MS,
+    {0, 2, 3},
+    {2, 1, 1},
+    {{{0xFF, 0xFF, 0x00}, MIN_BRIGHTNESS, FEEDBACK_NO_CUE, 0, 0},
+     {{0xFF, 0xFF, 0x00}, MAX_BRIGHTNESS, FEEDBACK_NO_CUE, KF_FADE, 150},
+     {{0x00, 0xFF, 0x00}, MAX_BRIGHTNESS, SOUND_GRANTED, 0, 200},
+     {{0xFF, 0x00, 0x00}, MAX_BRIGHTNESS, SOUND_DENIED, 0, 300}},
+};
+#else
+static constexpr FeedbackTimeline FEEDBACK_BUILTIN = {
+    CHASER_INTERVAL_MS,
+    {0, 2, 3},
+    {2, 1, 1},
+    {{{0xFF, 0xFF, 0x00}, MIN_BRIGHTNESS, FEEDBACK_NO_CUE, 0, 0},
+     {{0xFF, 0xFF, 0x00}, MAX_BRIGHTNESS, FEEDBACK_NO_CUE, KF_FADE, 2000},
+     {{0x00, 0xFF, 0x00}, MAX_BRIGHTNESS, SOUND_GRANTED, KF_WAIT_AUDIO, 250},
+     {{0xFF, 0x00, 0x00}, MAX_BRIGHTNESS, SOUND_DENIED, 0, 1000}},
+};
+#endif
+
+// Validate a timeline file image into `out`; false (and `out` untouched)
+// if it is malformed or has more than FEEDBACK_MAX_KEYFRAMES keyframes
+bool feedbackTimelineParse(const uint8_t *data, size_t size, FeedbackTimeline &out);
+
+// Sum of a track's durations (a KF_WAIT_AUDIO keyframe counts its
+// fallback duration)
+uint32_t feedbackTrackMs(const FeedbackTimeline &t, FeedbackTrack track);
+
+#endif // FEEDBACK_TIMELINE_H
@@ -0,0 +1,78 @@
+/**************************************************************************/
+/*!
+    @file     host_link.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Binary tap stream to the access controller.
+              - One fixed 32-byte frame per tap (HostTapFrame): sync word,
+                sequence number, UID, result, timestamp, hot-path latency
+                breakdown and a CRC-16, all little-endian
+              - Sends never block: the frame is copied into the serial
+                driver's TX ring and the UART / USB interrupt drains it;
+                when the ring has no room the frame is dropped and counted
+                (the sequence number shows the gap to the host)
+              - Output on a UART (HOST_LINK 1, an RS-485 transceiver can
+                sit on its pins) or interleaved with the USB CDC console
+                (HOST_LINK 2; the sync word + CRC let the host skip text)
+*/
+/**************************************************************************/
+
+#ifndef HOST_LINK_H
+#define HOST_LINK_H
+
+#include <Arduino.h>
+#include "config.h"
+
+static constexpr uint8_t HOST_SYNC_0 = 0xA5;
+static constexpr uint8_t HOST_SYNC_1 = 0x5A;
+static constexpr uint8_t HOST_FRAME_VERSION = 1;
+
+typedef enum : uint8_t
+{
+    HOST_FRAME_TAP = 1
+} HostFrameType;
+
+struct __attribute__((packed)) HostTapFrame
+{
+    uint8_t sync[2];      // HOST_SYNC_0, HOST_SYNC_1
+    uint8_t version;      // HOST_FRAME_VERSION
+    uint8_t type;         // HostFrameType
+    uint16_t seq;         // +1 per frame queued or dropped
+    uint16_t tapId;       // latency trace id, 0 with LATENCY_TRACE off
+    uint32_t uptimeMs;    // millis() at the decision
+    uint8_t result;       // AccessResult
+    uint8_t uidLength;
+    uint8_t uid[7];
+    uint8_t cardData;     // CardDataKind
+    uint16_t uidReadUs;   // rf_detect -> UID read (saturates at 65535)
+    uint16_t cardDataUs;  // UID read -> card data stage done
+    uint16_t decisionUs;  // rf_detect -> decision posted to the LED task
+    uint16_t reserved;
+    uint16_t crc;         // CRC-16/CCITT-FALSE of every byte above
+};
+static_assert(sizeof(HostTapFrame) == 32, "HostTapFrame is a 32-byte wire format");
+
+#if HOST_LINK
+
+// Open the configured port; call once from setup()
+void hostLinkBegin();
+
+// Queue the frame for tap `tapId`; false if it was dropped.
+// Single producer: only call from the authorization stage (Auth task).
+bool hostLinkSendTap(uint16_t tapId, uint8_t result, const uint8_t *uid, uint8_t uidLength,
+                     uint8_t cardData);
+
+// Frames sent / dropped
+void hostLinkReport(Print &out);
+
+#else
+
+static inline void hostLinkBegin() {}
+static inline bool hostLinkSendTap(uint16_t, uint8_t, const uint8_t *, uint8_t, uint8_t)
+{
+    return false;
+}
+static inline void hostLinkReport(Print &out) { out.println(F("[HOST] disabled")); }
+
+#endif
+
+#endif // HOST_LINK_H
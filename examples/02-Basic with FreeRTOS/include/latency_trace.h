@@ -0,0 +1,56 @@
+/**************************************************************************/
+/*!
+    @file     latency_trace.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Per-tap hot-path timestamps, RF detection -> first audio sample.
+              - Each tap gets an id at RF detection; the id travels in the
+                ReaderEvent and every stage stamps its slot in a ring
+              - Each stage is written by exactly one task, so no locks
+              - latencyReport() prints p50 / p99 / max per stage
+*/
+/**************************************************************************/
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+typedef enum : uint8_t
+{
+    LAT_RF_DETECT,    // PN532 IRQ edge / poll return
+    LAT_UID_READ,     // UID read back over SPI
+    LAT_CARD_DATA,    // card data stage done (card_data.h)
+    LAT_EVENT_POST,   // EVT_CARD_DETECTED posted to the LED task
+    LAT_LED_WAKE,     // LED task received it
+    LAT_RAMP_START,   // first ramp frame committed
+    LAT_SUCCESS,      // transitionToSuccess()
+    LAT_AUDIO_START,  // PcmPlayer::start() / connecttoFS() returned
+    LAT_FIRST_SAMPLE, // first samples handed to I2S
+    LAT_STAGE_COUNT
+} LatencyStage;
+
+#if LATENCY_TRACE
+
+// Open a trace for a new tap detected at `rfTimeUs`; returns its id (never 0)
+uint16_t latencyBeginTap(uint32_t rfTimeUs);
+
+// Stamp `stage` of tap `tapId` with the current time (id 0 is ignored)
+void latencyMark(uint16_t tapId, LatencyStage stage);
+
+// Microseconds from rf_detect to `stage` of tap `tapId`; 0 if the stage
+// was not reached or the slot has been reused by a later tap
+uint32_t latencySinceRf(uint16_t tapId, LatencyStage stage);
+
+void latencyReport(Print &out);
+
+#else
+
+static inline uint16_t latencyBeginTap(uint32_t) { return 0; }
+static inline void latencyMark(uint16_t, LatencyStage) {}
+static inline uint32_t latencySinceRf(uint16_t, LatencyStage) { return 0; }
+static inline void latencyReport(Print &out) { out.println(F("[LAT] disabled")); }
+
+#endif
+
+#endif // LATENCY_TRACE_H
@@ -0,0 +1,74 @@
+/**************************************************************************/
+/*!
+    @file     led_renderer.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Frame-scheduled LED output.
+              - Effects draw into the frame and commit() it
+              - A frame identical to the one on the strip (pixels and
+                brightness) is dropped without touching the RMT
+              - Changed frames go out at most LED_TARGET_FPS times/s
+              - With LED_OUTPUT_ASYNC_RMT the frame is encoded into one of
+                two RMT item buffers and transmitted in the background;
+                the other buffer takes the next frame
+*/
+/**************************************************************************/
+
+#ifndef LED_RENDERER_H
+#define LED_RENDERER_H
+
+#include <Arduino.h>
+#include <FastLED.h>
+#include <led_effects.h>
+#include "config.h"
+
+#if LED_OUTPUT_ASYNC_RMT
+#include <driver/rmt.h>
+#endif
+
+class LedRenderer
+{
+public:
+    void begin();
+
+    // Drawing; every call marks the frame dirty
+    void fill(const CRGB &c);
+    void set(uint8_t index, const CRGB &c);
+    void setBrightness(uint8_t b);
+
+    // Copy a precomputed effect frame (NUM_LEDS RGB triplets) and its
+    // brightness
+    void draw(const fx::Frame &f);
+
+    // Send the frame if it changed and the frame budget allows it.
+    // Returns the ticks until a still-pending frame can go out, or
+    // portMAX_DELAY if nothing is pending.
+    TickType_t commit();
+
+    // Send the frame now, ignoring the frame budget (if it changed). If
+    // the output is still busy the frame stays pending for commit().
+    void flush();
+
+    uint32_t framesShown() const { return shown; }
+    uint32_t framesSkipped() const { return skipped; }
+
+private:
+    bool unchanged() const;
+    bool show(); // false if the output is still busy with the previous frame
+
+    CRGB pixels[NUM_LEDS];
+    CRGB onStrip[NUM_LEDS];
+    uint8_t brightness = MAX_BRIGHTNESS;
+    uint8_t onStripBrightness = 0;
+    bool dirty = false;
+    TickType_t lastShowTick = 0;
+    uint32_t shown = 0;
+    uint32_t skipped = 0;
+
+#if LED_OUTPUT_ASYNC_RMT
+    static constexpr size_t RMT_ITEMS = NUM_LEDS * 24;
+    rmt_item32_t rmtItems[2][RMT_ITEMS];
+    uint8_t backBuffer = 0;
+#endif
+};
+
+#endif // LED_RENDERER_H
@@ -0,0 +1,68 @@
+/**************************************************************************/
+/*!
+    @file     metrics.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Runtime metrics stream on the USB CDC console.
+              - Hot paths only bump relaxed atomic counters
+                (metricsCount()) or store a level; everything else is
+                sampled by a low-priority task every period
+              - One record per sample in InfluxDB line protocol: a
+                `reader` line with rates / levels and one `task` line
+                per FreeRTOS task (CPU share, stack high-water mark)
+              - The period is set at build time (METRICS_PERIOD_MS) and
+                at runtime ("metrics <ms>" on the console, 0 stops it)
+*/
+/**************************************************************************/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+typedef enum : uint8_t
+{
+    MET_NFC_POLL,       // InListPassiveTarget armed / issued
+    MET_NFC_HIT,        // ... that returned a target
+    MET_LED_LATE,       // LED task woke a frame or more after its deadline
+    MET_AUDIO_UNDERRUN, // decoder input buffer ran dry while playing
+    MET_NFC_FAULT,      // PN532 exchange without ACK / with a bad frame
+    MET_NFC_RESET,      // PN532 hard resets (nfc_health.h)
+    MET_AUTH_DROP,      // tap dropped, authorization stage inbox full
+    MET_LOG_FAIL,       // tap log file could not be rotated / written
+    MET_COUNTER_COUNT
+} MetricCounter;
+
+extern uint32_t metricCounters[MET_COUNTER_COUNT];
+
+static inline void metricsCount(MetricCounter c)
+{
+    __atomic_fetch_add(&metricCounters[c], 1, __ATOMIC_RELAXED);
+}
+
+// Levels and totals owned by other modules, read when a sample is taken
+struct MetricsLevels
+{
+    uint32_t ledShown;
+    uint32_t ledSkipped;
+    uint8_t ledQueue;     // events waiting for the LED task
+    uint8_t audioQueue;   // events waiting for the audio task
+    uint8_t authQueue;    // scans waiting for the authorization stage
+    uint8_t audioInPct;   // decoder input buffer fill, 0 when idle
+    uint32_t readAheadKb; // SD read-ahead ring fill
+    uint32_t readAheadStalls;
+    uint32_t nfcRecoverMs; // last PN532 recovery
+};
+
+typedef void (*MetricsLevelsFn)(MetricsLevels &out);
+
+// Start the sampler task; `levels` is called from it on every sample
+bool metricsBegin(MetricsLevelsFn levels);
+
+// 0 stops the stream
+void metricsSetPeriod(uint32_t periodMs);
+
+// Print one sample now (also works with the stream stopped)
+void metricsSample(Print &out);
+
+#endif // METRICS_H
@@ -0,0 +1,94 @@
+/**************************************************************************/
+/*!
+    @file     nfc_health.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    PN532 health monitor and hard-reset recovery.
+              - Every exchange the NFC task makes reports ok / fault; a
+                fault is a command without ACK, a corrupt response frame
+                or a bounded scan that never answered
+              - NFC_FAULT_LIMIT faults in a row pull PN532_RESET low,
+                wait for the chip to boot and run SAMConfig again, all
+                from the NFC task (LED and audio tasks keep running)
+              - The NFC task is subscribed to the task watchdog
+                (NFC_WATCHDOG) and feeds it every pass of its loop and
+                during long waits; it trips if the loop itself stops.
+                Only TASK_WDT_TIMEOUT_S changes the system TWDT settings.
+*/
+/**************************************************************************/
+
+#ifndef NFC_HEALTH_H
+#define NFC_HEALTH_H
+
+#include <Arduino.h>
+#include <esp_task_wdt.h>
+#include "config.h"
+#include "pn532_link.h"
+
+// Longest the NFC task blocks without feeding the watchdog: long waits
+// are cut into slices of this
+static constexpr uint32_t NFC_WATCHDOG_SLICE_MS = 1000;
+
+#if TASK_WDT_TIMEOUT_S
+static constexpr uint32_t NFC_WATCHDOG_TIMEOUT_S = TASK_WDT_TIMEOUT_S;
+#else
+static constexpr uint32_t NFC_WATCHDOG_TIMEOUT_S = CONFIG_ESP_TASK_WDT_TIMEOUT_S;
+#endif
+
+// A slice plus a recovery attempt must fit in the timeout
+static_assert(!NFC_WATCHDOG ||
+                  NFC_WATCHDOG_TIMEOUT_S * 1000UL > NFC_WATCHDOG_SLICE_MS + NFC_RECOVERY_RETRY_MS + 1000UL,
+              "task watchdog timeout too short for the NFC loop");
+
+class NfcHealth
+{
+public:
+    void onOk() { faults = 0; }
+
+    // true when the PN532 should be reset; the count only restarts after
+    // a successful exchange, so a failed recovery is retried
+    bool onFault() { return ++faults >= NFC_FAULT_LIMIT; }
+
+    void onRecovery(bool ok, uint32_t ms)
+    {
+        lastMs = ms;
+        if (ok)
+        {
+            faults = 0;
+            worstMs = max(worstMs, ms);
+        }
+    }
+
+    uint32_t lastRecoveryMs() const { return lastMs; }
+    uint32_t worstRecoveryMs() const { return worstMs; }
+
+private:
+    uint8_t faults = 0;
+    uint32_t lastMs = 0;
+    uint32_t worstMs = 0;
+};
+
+// Drive PN532_RESET high (chip running); call once before the first frame
+void pn532ResetBegin();
+
+// Pulse PN532_RESET, wait for the chip to boot and send SAMConfig (normal
+// mode, IRQ on). Without a reset pin only the SAMConfig is retried.
+// true once the PN532 answered.
+bool pn532HardReset(Pn532Link &link);
+
+// Subscribe the calling task to the task watchdog as it is configured
+static inline void nfcWatchdogBegin()
+{
+#if NFC_WATCHDOG
+    esp_task_wdt_add(nullptr);
+#endif
+}
+
+// Once per pass of the NFC loop, and per slice of a long wait
+static inline void nfcWatchdogFeed()
+{
+#if NFC_WATCHDOG
+    esp_task_wdt_reset();
+#endif
+}
+
+#endif // NFC_HEALTH_H
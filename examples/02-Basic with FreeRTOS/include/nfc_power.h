@@ -0,0 +1,55 @@
+/**************************************************************************/
+/*!
+    @file     nfc_power.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Adaptive PN532 polling for low idle power.
+              - Right after a card (and for NFC_ACTIVE_HOLD_MS) the reader
+                keeps its RF field searching continuously
+              - After that it duty-cycles: a short bounded scan, then
+                PowerDown until the next one; the gap doubles every
+                NFC_BACKOFF_STEP_MS of idle time up to NFC_POLL_MAX_MS
+              - Any card snaps it back to continuous searching
+*/
+/**************************************************************************/
+
+#ifndef NFC_POWER_H
+#define NFC_POWER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "pn532_link.h"
+
+class NfcPollPolicy
+{
+public:
+    // A card was read, or the reader is busy with feedback
+    void onActivity(uint32_t nowMs) { lastActivityMs = nowMs; }
+
+    // true -> bounded scans with PowerDown in between
+    bool dutyCycled(uint32_t nowMs) const
+    {
+        return NFC_ADAPTIVE_POLL && nowMs - lastActivityMs >= NFC_ACTIVE_HOLD_MS;
+    }
+
+    // Field-off time before the next scan
+    uint32_t sleepMs(uint32_t nowMs) const
+    {
+        uint32_t idleMs = nowMs - lastActivityMs - NFC_ACTIVE_HOLD_MS;
+        uint32_t ms = NFC_POLL_SLOW_MS;
+        for (uint32_t steps = idleMs / NFC_BACKOFF_STEP_MS; steps > 0 && ms < NFC_POLL_MAX_MS; steps--)
+        {
+            ms *= 2;
+        }
+        return min<uint32_t>(ms, NFC_POLL_MAX_MS);
+    }
+
+private:
+    uint32_t lastActivityMs = 0;
+};
+
+// Send PowerDown (RF field off, ~10 uA). The PN532 wakes on the next SPI
+// access and, with `wakeOnField`, when its RF level detector sees an
+// external field; it then pulls IRQ low.
+bool pn532PowerDown(Pn532Link &link, bool wakeOnField);
+
+#endif // NFC_POWER_H
@@ -0,0 +1,56 @@
+/**************************************************************************/
+/*!
+    @file     nfc_targets.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    ISO14443A target listing with up to NFC_MAX_TARGETS cards.
+              - One InListPassiveTarget (MaxTg = NFC_MAX_TARGETS) resolves
+                the anticollision on the PN532 and returns every UID in
+                the same RF round-trip, so two badges presented together
+                (a wallet) are both seen instead of colliding and retrying
+              - Each entry keeps the PN532 logical number (Tg) used to
+                address that card in later InDataExchange frames
+*/
+/**************************************************************************/
+
+#ifndef NFC_TARGETS_H
+#define NFC_TARGETS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "pn532_link.h"
+
+// The PN532 lists at most two targets per InListPassiveTarget
+static_assert(NFC_MAX_TARGETS >= 1 && NFC_MAX_TARGETS <= 2, "NFC_MAX_TARGETS must be 1 or 2");
+
+struct NfcTarget
+{
+    uint8_t tg;     // logical number for InDataExchange
+    uint8_t selRes; // SEL_RES (SAK): card family
+    uint8_t uidLength;
+    uint8_t uid[7];
+};
+
+typedef enum : uint8_t
+{
+    NFC_ARM_FAULT,   // no ACK: the PN532 did not take the command
+    NFC_ARM_PENDING, // armed, the response follows on IRQ
+    NFC_ARM_READY    // response already waiting (card on the reader)
+} NfcArm;
+
+// Start InListPassiveTarget and wait for its ACK
+NfcArm nfcArmTargets(Pn532Link &link);
+
+// Read the response of an armed scan; returns how many targets it holds,
+// or -1 on a bad frame
+int nfcReadTargets(Pn532Link &link, NfcTarget *out);
+
+// Blocking scan for polling mode and re-selection: the number of targets,
+// 0 when no card answered in time, -1 when the PN532 did not (no ACK, bad
+// frame)
+int nfcListTargets(Pn532Link &link, NfcTarget *out, uint32_t timeoutMs);
+
+// Decode the InListPassiveTarget (106 kbps type A) payload after the
+// response code; targets with a UID longer than 7 bytes are skipped
+uint8_t nfcParseTargets(const uint8_t *resp, int len, NfcTarget *out);
+
+#endif // NFC_TARGETS_H
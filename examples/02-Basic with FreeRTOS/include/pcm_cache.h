@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*!
+    @file     pcm_cache.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Pre-decoded PCM cache for the feedback clips.
+              - MP3 on SD is decoded once into a raw PCM file on LittleFS
+              - At boot the PCM is loaded into PSRAM (if present) or
+                streamed from LittleFS
+              - PcmPlayer pushes it straight into the I2S DMA buffers,
+                no SD access and no decoder on the hot path
+*/
+/**************************************************************************/
+
+#ifndef PCM_CACHE_H
+#define PCM_CACHE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "spi_bus.h"
+
+// ======================= CACHED CLIP ==========================
+struct PcmClip
+{
+    bool valid = false;
+    uint32_t sampleRate = 0;
+    uint8_t channels = 0;
+    uint32_t frames = 0;       // samples per channel
+    int16_t *pcm = nullptr;    // PSRAM copy, nullptr -> stream from cachePath
+    char cachePath[32] = {0};
+    mutable fs::File file;     // cachePath kept open when streaming
+};
+
+// Mount LittleFS (formatted on first use)
+bool pcmCacheBegin();
+
+// Make `clip` playable. Uses the LittleFS cache when it matches the source
+// file, otherwise decodes `mp3Path` from `src` (only if `srcOk`) first.
+// Without PSRAM the cache file is left open in clip.file. Reads from `src`
+// take `srcBus` (if given) one input chunk at a time.
+bool pcmCacheLoad(PcmClip &clip, fs::FS &src, bool srcOk,
+                  const char *mp3Path, const char *cachePath,
+                  SpiBus *srcBus = nullptr);
+
+// ======================= PLAYER ==========================
+// Streams a PcmClip into the I2S port already set up by the Audio object.
+// Only one of Audio / PcmPlayer may be playing at a time.
+class PcmPlayer
+{
+public:
+    // volume uses the same 0..21 scale as Audio::setVolume(); the gain
+    // ramps up from 0 over the first fadeMs of the clip
+    bool start(const PcmClip &clip, uint8_t volume, uint16_t fadeMs = 0);
+    void stop();
+
+    // Fill whatever room is left in the DMA buffers; never blocks
+    void service();
+
+    bool isRunning() const { return running; }
+
+    // true once the first samples of the current clip reached I2S
+    bool outputStarted() const { return started; }
+
+private:
+    static constexpr size_t CHUNK_FRAMES = 256;
+
+    bool fillChunk();
+
+    const PcmClip *clip = nullptr;
+    fs::File *in = nullptr;    // clip->file, or ownFile if it had none
+    fs::File ownFile;
+    bool running = false;
+    bool started = false;
+    uint32_t pos = 0;          // next frame to stage
+    uint16_t gain = 0;         // Q8
+    uint32_t fadeFrames = 0;   // gain ramp length from frame 0
+    int16_t chunk[CHUNK_FRAMES * 2];
+    size_t chunkBytes = 0;
+    size_t chunkSent = 0;
+};
+
+#endif // PCM_CACHE_H
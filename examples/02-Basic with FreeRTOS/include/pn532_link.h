@@ -0,0 +1,70 @@
+/**************************************************************************/
+/*!
+    @file     pn532_link.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Raw PN532 frame transport over hardware SPI.
+              - Same wire protocol the Adafruit driver speaks, but split
+                into send / status / read steps and with a selectable clock
+                (the driver pins its SPI device at 1 MHz)
+              - Used where a command is not exposed by Adafruit_PN532 or
+                where the exchange must not block
+*/
+/**************************************************************************/
+
+#ifndef PN532_LINK_H
+#define PN532_LINK_H
+
+#include <Arduino.h>
+#include <SPI.h>
+#include "spi_bus.h"
+
+class Pn532Link
+{
+public:
+    Pn532Link(SPIClass &bus, uint8_t csPin) : spi(bus), ss(csPin) {}
+
+    // PN532 SPI is specified up to 5 MHz
+    void setClock(uint32_t hz) { clockHz = hz; }
+    uint32_t clock() const { return clockHz; }
+
+    // Take `bus` around every frame when the host is shared
+    void attach(SpiBus &bus) { arbiter = &bus; }
+
+    // Write one host -> PN532 command frame (cmd[0] is the command code)
+    bool sendCommand(const uint8_t *cmd, uint8_t cmdLen);
+
+    // Status byte says an ACK or response frame is waiting
+    bool isReady();
+
+    bool readAck();
+
+    // Read the response to `command`; copies the payload after the
+    // response code into `out` and returns its length, or -1 on a bad frame
+    int readResponse(uint8_t command, uint8_t *out, uint8_t maxLen);
+
+    // Send `cmd` and wait for its ACK; the response is left for a later
+    // isReady() / readResponse(), e.g. once the IRQ line drops
+    bool startCommand(const uint8_t *cmd, uint8_t cmdLen, uint32_t timeoutMs);
+
+    // Poll the status byte until a frame is waiting; false on timeout
+    bool waitReady(uint32_t timeoutMs);
+
+    // Abort the pending command (an ACK frame from the host cancels it)
+    void abort();
+
+    // Blocking send -> ACK -> response with a timeout, for boot / tools.
+    // Returns the payload length, or -1 on timeout / error.
+    int transceive(const uint8_t *cmd, uint8_t cmdLen,
+                   uint8_t *out, uint8_t maxLen, uint32_t timeoutMs);
+
+private:
+    void begin();
+    void end();
+
+    SPIClass &spi;
+    uint8_t ss;
+    uint32_t clockHz = 1000000;
+    SpiBus *arbiter = nullptr;
+};
+
+#endif // PN532_LINK_H
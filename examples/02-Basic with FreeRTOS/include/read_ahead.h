@@ -0,0 +1,45 @@
+/**************************************************************************/
+/*!
+    @file     read_ahead.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    SD read-ahead for the decoder fallback.
+              - A producer task keeps a PSRAM ring topped up with large
+                sequential reads (AUDIO_READAHEAD_CHUNK_KB each)
+              - readAheadFS() is an fs::FS whose files are served from
+                that ring, so audio.loop() copies from memory instead of
+                issuing SD commands on the audio core
+              - One stream at a time: opening a file retires the last one
+*/
+/**************************************************************************/
+
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "config.h"
+#include "spi_bus.h"
+
+// Allocate the ring and start the producer over `src` (reads take `bus`
+// when given). false without PSRAM or with AUDIO_READAHEAD off: keep
+// reading `src` directly then.
+bool readAheadBegin(fs::FS &src, SpiBus *bus);
+
+// Read-only view of `src` through the ring; only valid after a
+// successful readAheadBegin()
+fs::FS &readAheadFS();
+
+struct ReadAheadStats
+{
+    uint32_t buffered; // bytes in the ring ahead of the decoder
+    uint32_t reads;    // SD reads issued so far
+    uint32_t stalls;   // decoder reads that found the ring empty
+};
+
+// All zero while the read-ahead is off
+ReadAheadStats readAheadStats();
+
+// Ring fill, SD reads issued and consumer stalls so far
+void readAheadReport(Print &out);
+
+#endif // READ_AHEAD_H
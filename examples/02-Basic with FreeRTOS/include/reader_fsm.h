@@ -0,0 +1,142 @@
+/**************************************************************************/
+/*!
+    @file     reader_fsm.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Reader state machine, independent of the hardware.
+              - IDLE chaser -> yellow ramp -> green until the clip ends,
+                or red for a denied card; taps arriving meanwhile queue up
+              - What each state shows and for how long comes from a
+                feedback timeline (feedback_timeline.h), built-in or
+                loaded from a file
+              - Time, LEDs, audio and the state / latency reporting are
+                reached through the interfaces below: the LED task wires
+                them to the board, the native sim env (sim/) to mocks
+              - The NFC side is the input: onCard() per accepted tap
+              - Not thread safe; one task (or the simulator) drives it
+*/
+/**************************************************************************/
+
+#ifndef READER_FSM_H
+#define READER_FSM_H
+
+#include <Arduino.h>
+#include <led_effects.h>
+#include "config.h"
+#include "feedback_timeline.h"
+#include "latency_trace.h"
+#include "shared_state.h"
+#include "sound_id.h"
+
+// ======================= PORTS ==========================
+class ReaderClock
+{
+public:
+    virtual int64_t nowUs() = 0;
+};
+
+class ReaderLeds
+{
+public:
+    // Whole strip one colour (0xRRGGBB) at `brightness`
+    virtual void fill(uint32_t rgb, uint8_t brightness) = 0;
+    virtual void draw(const fx::Frame &f) = 0;
+};
+
+class ReaderAudio
+{
+public:
+    // false if `sound` will not play (no source, or the request could not
+    // be queued): nothing waits for its onAudioDone() then
+    virtual bool play(SoundId sound, uint16_t tapId) = 0;
+};
+
+class ReaderTrace
+{
+public:
+    virtual void publish(const ReaderSnapshot &snap) = 0;
+    virtual void mark(uint16_t tapId, LatencyStage stage) = 0;
+};
+
+// ======================= STATE MACHINE ==========================
+// One accepted tap, as decided on the NFC side
+struct ReaderTap
+{
+    uint16_t tapId;    // latency trace id, 0 -> none
+    bool granted;
+    uint8_t uidLength;
+    uint8_t uid[7];
+};
+
+class ReaderFsm
+{
+public:
+    static constexpr uint32_t WAIT_FOREVER = 0xFFFFFFFFu;
+
+    ReaderFsm(ReaderClock &clock, ReaderLeds &leds, ReaderAudio &audio, ReaderTrace &trace)
+        : clock(clock), leds(leds), audio(audio), trace(trace) {}
+
+    // Enter IDLE, unless a fault was reported first
+    void begin();
+
+    // Draw what is due; returns the ms until the next deadline (0 -> call
+    // again right away, WAIT_FOREVER -> only an input changes anything)
+    uint32_t step();
+
+    // Inputs. onCard() returns false if the tap had to be dropped.
+    bool onCard(const ReaderTap &tap);
+    void onFault();
+    void onRecovered(); // leaves ERROR for IDLE
+    void onAudioDone(SoundId sound);
+
+    // Feedback from now on (IDLE / ERROR) or from the next tap on; `t`
+    // must stay valid while in use
+    void setTimeline(const FeedbackTimeline &t);
+
+    ReaderState current() const { return state; }
+    uint8_t queued() const { return pendingCount; }
+
+private:
+    static constexpr uint8_t PENDING_TAPS = 4;
+
+    void changeState(ReaderState newState);
+    void fillAll(uint32_t rgb);
+    void resetToIdle();
+    void errorState();
+    void deniedState();
+    void transitionToSuccess();
+    void startTap(const ReaderTap &tap);
+    void nextTapOrIdle();
+    uint32_t stateElapsedMs();
+    uint32_t runChaserStep();
+    void enterTrack(FeedbackTrack t);
+    void enterKeyframe(uint8_t index, int64_t startUs);
+    void nextKeyframe(int64_t startUs);
+    uint32_t drawKeyframe(const FeedbackKeyframe &k, uint32_t elapsedMs);
+    uint32_t runTrack();
+    uint32_t endTrack();
+
+    ReaderClock &clock;
+    ReaderLeds &leds;
+    ReaderAudio &audio;
+    ReaderTrace &trace;
+
+    ReaderState state = STATE_IDLE;
+    int64_t stateStartUs = 0;
+    ReaderTap shown = {};         // tap being shown
+    uint16_t rampTapId = 0;       // tap whose ramp start was traced
+
+    // Timeline in use, and the one to switch to at the next tap
+    const FeedbackTimeline *timeline = &FEEDBACK_BUILTIN;
+    const FeedbackTimeline *staged = &FEEDBACK_BUILTIN;
+    FeedbackTrack track = TRACK_DETECTED;
+    uint8_t keyIndex = 0;             // keyframe within the track
+    int64_t keyStartUs = 0;
+    uint8_t keyFrom = 0;              // level a KF_FADE keyframe starts from
+    uint8_t waitCue = FEEDBACK_NO_CUE; // clip the keyframe waits for
+
+    ReaderTap pendingTaps[PENDING_TAPS];
+    uint8_t pendingHead = 0;
+    uint8_t pendingCount = 0;
+};
+
+#endif // READER_FSM_H
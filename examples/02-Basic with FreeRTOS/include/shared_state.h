@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*!
+    @file     shared_state.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Lock-free view of the reader state for the other tasks.
+              - The LED task owns the state machine and is the only writer
+              - Readers get a consistent {state, UID, tap id, timestamp}
+                snapshot through a seqlock: no mutex, the writer never
+                waits, a reader retries if it raced a publish
+              - The bare state is also kept as a single atomic for cheap
+                checks on the NFC path
+*/
+/**************************************************************************/
+
+#ifndef SHARED_STATE_H
+#define SHARED_STATE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+struct ReaderSnapshot
+{
+    ReaderState state;
+    uint8_t uidLength;  // card being shown, 0 when idle
+    uint8_t uid[7];
+    uint16_t tapId;     // latency trace id of that card
+    int64_t sinceUs;    // esp_timer_get_time() at the state change
+};
+
+// Writer side: LED task only
+void sharedStatePublish(const ReaderSnapshot &snap);
+
+// Any task / core
+ReaderSnapshot sharedStateRead();
+ReaderState sharedStateCurrent();
+
+#endif // SHARED_STATE_H
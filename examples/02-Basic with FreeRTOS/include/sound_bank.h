@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*!
+    @file     sound_bank.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Feedback clips indexed by SoundId.
+              - Every clip is resolved once at boot: decoded into the PCM
+                cache and held in PSRAM or as an open LittleFS handle
+              - Playing a clip is an index lookup, no path or directory
+                search on the hot path
+              - The SD path is kept for the decoder fallback
+*/
+/**************************************************************************/
+
+#ifndef SOUND_BANK_H
+#define SOUND_BANK_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "pcm_cache.h"
+#include "spi_bus.h"
+#include "sound_id.h"
+
+// Load every clip; call after pcmCacheBegin(). `sd` is only read if `sdOk`.
+// May run in a background task: nothing is reported available before the
+// whole bank is loaded. SD access goes through `sdBus` when given.
+void soundBankBegin(fs::FS &sd, bool sdOk, SpiBus *sdBus = nullptr);
+
+// Cached clip (clip.valid is false if it could not be cached)
+const PcmClip &soundClip(SoundId id);
+
+// MP3 on SD for the decoder fallback, nullptr if the card does not have it
+const char *soundSdPath(SoundId id);
+
+// true if the clip can be played one way or the other
+bool soundAvailable(SoundId id);
+
+#endif // SOUND_BANK_H
@@ -0,0 +1,24 @@
+/**************************************************************************/
+/*!
+    @file     sound_id.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Feedback clip ids, shared by the sound bank and the reader
+              core (which has no file system of its own).
+*/
+/**************************************************************************/
+
+#ifndef SOUND_ID_H
+#define SOUND_ID_H
+
+#include <stdint.h>
+
+typedef enum : uint8_t
+{
+    SOUND_GRANTED,
+    SOUND_DENIED,
+    SOUND_EXPIRED,
+    SOUND_ERROR,
+    SOUND_COUNT
+} SoundId;
+
+#endif // SOUND_ID_H
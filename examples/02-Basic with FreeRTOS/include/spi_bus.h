@@ -0,0 +1,85 @@
+/**************************************************************************/
+/*!
+    @file     spi_bus.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Priority arbitration for devices sharing one SPI host.
+              - Each device keeps its own clock / mode: it still opens a
+                beginTransaction() with its SPISettings inside the lock
+              - A waiter of higher priority makes lower ones back off,
+                so a PN532 exchange never queues behind SD streaming for
+                more than the transfer already on the wire
+              - Holders batch: take the bus once, run every transfer of
+                a frame / read chunk, release
+*/
+/**************************************************************************/
+
+#ifndef SPI_BUS_H
+#define SPI_BUS_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// Lowest to highest
+typedef enum : uint8_t
+{
+    SPI_PRIO_BULK = 0, // SD streaming, cache decode
+    SPI_PRIO_CONTROL,  // SD mount, directory work
+    SPI_PRIO_NFC,      // PN532 frames
+    SPI_PRIO_COUNT
+} SpiPriority;
+
+class SpiBus
+{
+public:
+    explicit SpiBus(SPIClass &spi) : port(spi) {}
+
+    // Create the lock; call once before any task uses the bus
+    bool begin();
+
+    SPIClass &spi() { return port; }
+
+    // Blocks until the bus is free and nobody above `prio` is waiting.
+    // Re-entrant from the task that already holds it.
+    void acquire(SpiPriority prio);
+    void release();
+
+    // Longest acquire() wait per priority since the last report
+    void report(Print &out, const char *name);
+
+private:
+    bool higherWaiting(SpiPriority prio) const;
+
+    SPIClass &port;
+    SemaphoreHandle_t lock = nullptr;
+    StaticSemaphore_t lockBuf; // backs `lock` with STATIC_ALLOC
+    uint8_t waiting[SPI_PRIO_COUNT] = {};
+    uint32_t maxWaitUs[SPI_PRIO_COUNT] = {};
+};
+
+// Scoped acquire; a null bus makes it a no-op
+class SpiBusLock
+{
+public:
+    SpiBusLock(SpiBus *bus, SpiPriority prio) : bus(bus)
+    {
+        if (bus)
+        {
+            bus->acquire(prio);
+        }
+    }
+    SpiBusLock(SpiBus &bus, SpiPriority prio) : SpiBusLock(&bus, prio) {}
+    ~SpiBusLock()
+    {
+        if (bus)
+        {
+            bus->release();
+        }
+    }
+    SpiBusLock(const SpiBusLock &) = delete;
+    SpiBusLock &operator=(const SpiBusLock &) = delete;
+
+private:
+    SpiBus *bus;
+};
+
+#endif // SPI_BUS_H
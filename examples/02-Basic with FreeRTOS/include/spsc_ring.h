@@ -0,0 +1,63 @@
+/**************************************************************************/
+/*!
+    @file     spsc_ring.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Lock-free single-producer / single-consumer ring.
+              - Links two pipeline stages that run on different cores:
+                push() and pop() never block and never take a lock
+              - Head is only written by the producer, tail only by the
+                consumer; acquire / release on them publishes the slot
+              - N must be a power of two
+*/
+/**************************************************************************/
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <Arduino.h>
+
+template <typename T, uint32_t N>
+class SpscRing
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    // Producer side; false if the ring is full (the item is not queued)
+    bool push(const T &item)
+    {
+        uint32_t h = head;
+        if (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= N)
+        {
+            return false;
+        }
+        slots[h & (N - 1)] = item;
+        __atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Consumer side; false if the ring is empty
+    bool pop(T &out)
+    {
+        uint32_t t = tail;
+        if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t)
+        {
+            return false;
+        }
+        out = slots[t & (N - 1)];
+        __atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    // Items waiting; exact only on the consumer side, a hint elsewhere
+    uint32_t size() const
+    {
+        return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+    }
+
+private:
+    T slots[N];
+    uint32_t head = 0; // next slot to fill, producer only
+    uint32_t tail = 0; // next slot to drain, consumer only
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,70 @@
+/**************************************************************************/
+/*!
+    @file     static_alloc.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Zero-heap build option (STATIC_ALLOC).
+              - Task stacks / TCBs (task_profile.cpp) and event queues
+                live in .bss, so their size is known at link time
+              - Semaphores are created into caller-owned buffers
+              - Long-lived PSRAM buffers (resident clips, SD read-ahead
+                ring, decode scratch) are carved from one arena reserved
+                at boot; nothing is freed, so nothing fragments
+              - With STATIC_ALLOC 0 the same calls fall back to the heap
+*/
+/**************************************************************************/
+
+#ifndef STATIC_ALLOC_H
+#define STATIC_ALLOC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ======================= RTOS OBJECTS ==========================
+// `buf` must outlive the semaphore; it is unused without STATIC_ALLOC
+static inline SemaphoreHandle_t rtosMutex(StaticSemaphore_t &buf)
+{
+#if STATIC_ALLOC
+    return xSemaphoreCreateMutexStatic(&buf);
+#else
+    (void)buf;
+    return xSemaphoreCreateMutex();
+#endif
+}
+
+static inline SemaphoreHandle_t rtosRecursiveMutex(StaticSemaphore_t &buf)
+{
+#if STATIC_ALLOC
+    return xSemaphoreCreateRecursiveMutexStatic(&buf);
+#else
+    (void)buf;
+    return xSemaphoreCreateRecursiveMutex();
+#endif
+}
+
+static inline SemaphoreHandle_t rtosBinary(StaticSemaphore_t &buf)
+{
+#if STATIC_ALLOC
+    return xSemaphoreCreateBinaryStatic(&buf);
+#else
+    (void)buf;
+    return xSemaphoreCreateBinary();
+#endif
+}
+
+// ======================= PSRAM ARENA ==========================
+// Reserve the PSRAM_ARENA_KB arena; call once before anything below.
+// false without PSRAM (or with STATIC_ALLOC off: nothing to reserve).
+bool psramArenaBegin();
+
+// Block that lives until reboot; nullptr when PSRAM is missing or the
+// arena is full
+void *psramAlloc(size_t bytes);
+
+// Give a block back. From the arena only the latest block can be, which
+// covers the "allocate, then fail to fill it" paths.
+void psramFree(void *p);
+
+// Arena size and use (or free PSRAM heap without STATIC_ALLOC)
+void psramReport(Print &out);
+
+#endif // STATIC_ALLOC_H
@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*!
+    @file     tap_log.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Persistent audit trail of every accepted tap.
+              - tapLogAppend() only copies the record into a RAM ring, it
+                never touches flash and never blocks the tap pipeline
+              - A low-priority writer task appends page-sized batches to a
+                binary log on LittleFS and rotates the files
+              - Every record carries a CRC; after a power loss the log is
+                replayed up to the last intact record and continues in a
+                fresh file; a short write does the same at run time
+              - A record leaves the ring only once it is in the file: a
+                failed write keeps it for the next flush
+*/
+/**************************************************************************/
+
+#ifndef TAP_LOG_H
+#define TAP_LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// On-flash record, 16 per 256-byte flash page.
+// bootId is stamped by the writer: one more than the newest intact record
+// found in the log at boot, 0 with an empty log. A boot that logs no tap
+// leaves it unchanged for the next one, and an erased log restarts it.
+struct TapRecord
+{
+    uint16_t bootId;   // boot sequence, see above
+    uint8_t result;    // AccessResult
+    uint8_t uidLength;
+    uint32_t uptimeMs; // millis() at the tap
+    uint8_t uid[7];
+    uint8_t crc;       // CRC-8 of the 15 bytes above
+};
+
+#if TAP_LOG
+
+// Replay the log and start the writer task; LittleFS must be mounted.
+// Taps appended before this are kept in the ring and written afterwards.
+bool tapLogBegin();
+
+// Queue a tap for the writer; false if the ring is full (record dropped).
+// Single producer: only call from the authorization stage (Auth task).
+bool tapLogAppend(const uint8_t *uid, uint8_t uidLength, uint8_t result);
+
+// Files, counters and the most recent records
+void tapLogReport(Print &out);
+
+#else
+
+static inline bool tapLogBegin() { return false; }
+static inline bool tapLogAppend(const uint8_t *, uint8_t, uint8_t) { return false; }
+static inline void tapLogReport(Print &out) { out.println(F("[LOG] disabled")); }
+
+#endif
+
+#endif // TAP_LOG_H
@@ -0,0 +1,50 @@
+/**************************************************************************/
+/*!
+    @file     task_profile.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Build-time task layout (core, priority, stack, period).
+              - One table per TASK_PROFILE, see config.h
+              - taskStart() creates a task from its table row and keeps
+                the handle for reporting
+              - taskReport() prints the stack high-water marks, so the
+                stack sizes can be trimmed to what the tasks really use
+*/
+/**************************************************************************/
+
+#ifndef TASK_PROFILE_H
+#define TASK_PROFILE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+typedef enum : uint8_t
+{
+    TASK_LED,
+    TASK_NFC,
+    TASK_AUDIO,
+    TASK_LOG,
+    TASK_READAHEAD,
+    TASK_METRICS,
+    TASK_AUTH,
+    TASK_COUNT
+} TaskId;
+
+struct TaskProfile
+{
+    const char *name;
+    BaseType_t core;
+    UBaseType_t priority;
+    uint32_t stackBytes;
+    uint32_t periodMs;  // service period for tasks that poll, 0 -> event driven
+};
+
+// Row of the active profile
+const TaskProfile &taskProfile(TaskId id);
+
+// Create `id` pinned to its core; false if the task could not be created
+bool taskStart(TaskId id, TaskFunction_t fn, TaskHandle_t *handle);
+
+// Profile name, then per task: core, priority, stack size and minimum free
+void taskReport(Print &out);
+
+#endif // TASK_PROFILE_H
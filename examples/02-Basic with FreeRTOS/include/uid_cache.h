@@ -0,0 +1,42 @@
+/**************************************************************************/
+/*!
+    @file     uid_cache.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Time-bounded UID de-duplication.
+              - Remembers the last few UIDs and when they were last read
+              - A UID read again inside the window is rejected and its
+                timestamp refreshed, so a card resting on the reader only
+                ever counts once
+*/
+/**************************************************************************/
+
+#ifndef UID_CACHE_H
+#define UID_CACHE_H
+
+#include <Arduino.h>
+
+class UidCache
+{
+public:
+    explicit UidCache(uint32_t window) : windowMs(window) {}
+
+    // true if `uid` was not seen in the last windowMs; always records it
+    bool accept(const uint8_t *uid, uint8_t uidLength, uint32_t nowMs);
+
+    void clear();
+
+private:
+    static constexpr uint8_t SLOTS = 8;
+
+    struct Entry
+    {
+        uint8_t uid[7];
+        uint8_t length; // 0 -> free slot
+        uint32_t lastSeenMs;
+    };
+
+    const uint32_t windowMs;
+    Entry entries[SLOTS] = {};
+};
+
+#endif // UID_CACHE_H
@@ -0,0 +1,41 @@
+/**************************************************************************/
+/*!
+    @file     Arduino.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Host stand-in for the few Arduino names the portable modules
+              (reader_fsm, card_record, config.h, latency / state headers)
+              use. Only on the include path of the native sim / test envs.
+*/
+/**************************************************************************/
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+#define F(s) (s)
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    size_t println(const char *s)
+    {
+        size_t n = 0;
+        while (*s)
+        {
+            n += write((uint8_t)*s++);
+        }
+        return n + write('\n');
+    }
+};
+
+#endif // SIM_ARDUINO_H
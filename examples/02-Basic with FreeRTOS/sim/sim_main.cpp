@@ -0,0 +1,451 @@
+/**************************************************************************/
+/*!
+    @file     sim_main.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Host-side simulation of the reader core (pio run -e sim -t exec).
+              - The real ReaderFsm (src/reader_fsm.cpp) on a discrete-event
+                clock; LEDs, audio and tracing are mocks on that clock
+              - Mock NFC: cards placed at random gaps and left on the
+                reader for a while, RF detect + UID / card data read
+                times, pipelined or blocking scans as in TaskNFC
+              - Per scenario: tap -> first feedback and tap -> verdict
+                (green / red) percentiles, taps/min, missed and dropped
+                taps, host time per simulated tap
+              The feedback timeline is the firmware's built-in one (build
+              env sim_fast for FEEDBACK_FAST_LANE), or a timeline file
+              given as the first argument (.pio/build/sim/program my.tl)
+*/
+/**************************************************************************/
+
+#include <stdio.h>
+#include <chrono>
+#include <queue>
+#include <vector>
+#include "reader_fsm.h"
+
+// ======================= SCENARIOS ==========================
+struct Scenario
+{
+    const char *name;
+    uint32_t taps;
+    uint32_t gapMs;        // mean time between two cards being placed (+-50 %)
+    uint32_t dwellMs;      // how long a card stays on the reader
+    uint8_t deniedPct;
+    bool pipelined;        // NFC_PIPELINED behaviour of TaskNFC
+    bool audio;            // clips available at all
+    uint32_t audioStartMs; // play request -> first sample
+    uint32_t clipMs;       // granted clip length
+};
+
+static const Scenario SCENARIOS[] = {
+    {"steady, PCM cache", 2000, 5000, 600, 10, true, true, 2, 1200},
+    {"steady, SD decoder", 2000, 5000, 600, 10, true, true, 45, 1200},
+    {"steady, no audio", 2000, 5000, 600, 10, true, false, 0, 0},
+    {"queue, pipelined", 2000, 1500, 600, 10, true, true, 2, 1200},
+    {"queue, blocking NFC", 2000, 1500, 600, 10, false, true, 2, 1200},
+    {"rush, pipelined", 2000, 400, 300, 10, true, true, 2, 1200},
+};
+
+// NFC model (IRQ mode): field activation until the PN532 reports the
+// target, then UID + card data over SPI. Pauses as in main.cpp.
+static constexpr uint32_t NFC_DETECT_MIN_MS = 5;
+static constexpr uint32_t NFC_DETECT_MAX_MS = 20;
+static constexpr uint32_t NFC_READ_MS = 8;
+static constexpr uint32_t NFC_RETAP_GAP_MS = 20;
+static constexpr uint32_t NFC_BLOCKING_PAUSE_MS = 300;
+static constexpr uint32_t NFC_BUSY_POLL_MS = 80;
+
+// Queue post -> consumer task running
+static constexpr uint32_t EVENT_HOP_US = 50;
+
+static constexpr uint32_t DENIED_CLIP_MS = 600;
+static constexpr uint32_t ERROR_CLIP_MS = 800;
+static constexpr uint32_t START_MS = 1000;
+static constexpr uint32_t DRAIN_MS = 60000; // run on after the last tap
+
+// ======================= DISCRETE-EVENT CLOCK ==========================
+typedef enum : uint8_t
+{
+    SIM_CARD_ON,
+    SIM_CARD_OFF,
+    SIM_NFC_SCAN,
+    SIM_NFC_READ,   // detect + read done for card `arg`
+    SIM_LED_EVENT,  // EVT_CARD_DETECTED for card `arg` reaches the LED task
+    SIM_LED_WAKE,   // animation deadline
+    SIM_AUDIO_DONE  // EVT_AUDIO_DONE for sound `arg`
+} SimEventKind;
+
+struct SimEvent
+{
+    int64_t atUs;
+    uint32_t seq; // FIFO among events at the same time
+    SimEventKind kind;
+    uint32_t arg;
+    uint32_t gen; // stale if it no longer matches its owner's generation
+};
+
+struct Later
+{
+    bool operator()(const SimEvent &a, const SimEvent &b) const
+    {
+        return a.atUs != b.atUs ? a.atUs > b.atUs : a.seq > b.seq;
+    }
+};
+
+struct TapTrace
+{
+    int64_t placedUs = 0;
+    int64_t feedbackUs = -1; // ramp or red on the strip
+    int64_t verdictUs = -1;  // green or red
+    int64_t doneUs = -1;     // back to idle / next tap
+    bool granted = true;
+    bool present = false;
+    bool read = false;
+    bool dropped = false;
+};
+
+static uint32_t rngState = 1;
+
+static uint32_t rng()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static uint32_t rngRange(uint32_t lo, uint32_t hi)
+{
+    return lo + rng() % (hi - lo + 1);
+}
+
+// ======================= MOCK BOARD ==========================
+// Clock, LEDs, audio and trace of one simulated reader, plus the NFC model
+class SimBoard : public ReaderClock, public ReaderLeds, public ReaderAudio, public ReaderTrace
+{
+public:
+    SimBoard(const Scenario &sc, const FeedbackTimeline &timeline)
+        : sc(sc), fsm(*this, *this, *this, *this)
+    {
+        fsm.setTimeline(timeline);
+    }
+
+    void run();
+    void report(double hostSeconds) const;
+
+    // ReaderClock
+    int64_t nowUs() override { return now; }
+
+    // ReaderLeds: frames cost nothing on the host, the state trace below
+    // says when feedback changed
+    void fill(uint32_t rgb, uint8_t brightness) override {}
+    void draw(const fx::Frame &f) override {}
+
+    // ReaderAudio: one clip at a time, a cut-in reports the old one done
+    bool play(SoundId sound, uint16_t tapId) override;
+
+    // ReaderTrace
+    void publish(const ReaderSnapshot &snap) override;
+    void mark(uint16_t tapId, LatencyStage stage) override {}
+
+private:
+    void at(int64_t us, SimEventKind kind, uint32_t arg = 0, uint32_t gen = 0);
+    void dispatch(const SimEvent &ev);
+    void runLed();
+    void kickNfc();
+    void scan();
+
+    const Scenario &sc;
+    ReaderFsm fsm;
+    int64_t now = 0;
+    std::priority_queue<SimEvent, std::vector<SimEvent>, Later> events;
+    uint32_t seq = 0;
+
+    std::vector<TapTrace> taps;
+    std::vector<uint32_t> present; // cards on the reader, oldest first
+    bool nfcBusy = false;          // a scan / read / pause is scheduled
+    uint32_t ledGen = 0;
+    uint32_t audioGen = 0;
+    bool audioPlaying = false;
+    SoundId audioSound = SOUND_GRANTED;
+    uint16_t shownTap = 0;
+};
+
+void SimBoard::at(int64_t us, SimEventKind kind, uint32_t arg, uint32_t gen)
+{
+    events.push({us, seq++, kind, arg, gen});
+}
+
+// TaskLEDState: step, then sleep until the returned deadline
+void SimBoard::runLed()
+{
+    uint32_t waitMs;
+    while ((waitMs = fsm.step()) == 0)
+    {
+    }
+    ledGen++;
+    if (waitMs != ReaderFsm::WAIT_FOREVER)
+    {
+        at(now + (int64_t)waitMs * 1000, SIM_LED_WAKE, 0, ledGen);
+    }
+}
+
+void SimBoard::kickNfc()
+{
+    if (!nfcBusy)
+    {
+        nfcBusy = true;
+        at(now, SIM_NFC_SCAN);
+    }
+}
+
+// TaskNFC: one armed scan for the oldest unread card on the reader
+void SimBoard::scan()
+{
+    if (!sc.pipelined && fsm.current() != STATE_IDLE)
+    {
+        at(now + NFC_BUSY_POLL_MS * 1000, SIM_NFC_SCAN);
+        return;
+    }
+    for (uint32_t card : present)
+    {
+        if (!taps[card].read)
+        {
+            uint32_t ms = rngRange(NFC_DETECT_MIN_MS, NFC_DETECT_MAX_MS) + NFC_READ_MS;
+            at(now + (int64_t)ms * 1000, SIM_NFC_READ, card);
+            return;
+        }
+    }
+    nfcBusy = false; // armed, the next card wakes it
+}
+
+void SimBoard::dispatch(const SimEvent &ev)
+{
+    switch (ev.kind)
+    {
+    case SIM_CARD_ON:
+        taps[ev.arg].present = true;
+        present.push_back(ev.arg);
+        kickNfc();
+        break;
+
+    case SIM_CARD_OFF:
+        taps[ev.arg].present = false;
+        present.erase(std::find(present.begin(), present.end(), ev.arg));
+        break;
+
+    case SIM_NFC_SCAN:
+        scan();
+        break;
+
+    case SIM_NFC_READ:
+    {
+        TapTrace &t = taps[ev.arg];
+        if (!t.present)
+        {
+            at(now, SIM_NFC_SCAN); // lifted before the read finished
+            break;
+        }
+        t.read = true;
+        at(now + EVENT_HOP_US, SIM_LED_EVENT, ev.arg);
+        uint32_t pauseMs = sc.pipelined ? NFC_RETAP_GAP_MS : NFC_BLOCKING_PAUSE_MS;
+        at(now + (int64_t)pauseMs * 1000, SIM_NFC_SCAN);
+        break;
+    }
+
+    case SIM_LED_EVENT:
+    {
+        ReaderTap tap = {};
+        tap.tapId = (uint16_t)(ev.arg + 1);
+        tap.granted = taps[ev.arg].granted;
+        tap.uidLength = 4;
+        memcpy(tap.uid, &ev.arg, 4);
+        taps[ev.arg].dropped = !fsm.onCard(tap);
+        runLed();
+        break;
+    }
+
+    case SIM_LED_WAKE:
+        if (ev.gen == ledGen)
+        {
+            runLed();
+        }
+        break;
+
+    case SIM_AUDIO_DONE:
+        if (ev.gen == 0 || ev.gen == audioGen)
+        {
+            if (ev.gen != 0)
+            {
+                audioPlaying = false;
+            }
+            fsm.onAudioDone((SoundId)ev.arg);
+            runLed();
+        }
+        break;
+    }
+}
+
+bool SimBoard::play(SoundId sound, uint16_t tapId)
+{
+    if (!sc.audio)
+    {
+        return false;
+    }
+    if (audioPlaying && sound != audioSound)
+    {
+        at(now + EVENT_HOP_US, SIM_AUDIO_DONE, audioSound, 0);
+    }
+    uint32_t clipMs = sound == SOUND_GRANTED ? sc.clipMs
+                      : sound == SOUND_DENIED ? DENIED_CLIP_MS
+                                              : ERROR_CLIP_MS;
+    audioPlaying = true;
+    audioSound = sound;
+    audioGen++;
+    int64_t endUs = now + EVENT_HOP_US + (int64_t)(sc.audioStartMs + clipMs) * 1000;
+    at(endUs + EVENT_HOP_US, SIM_AUDIO_DONE, sound, audioGen);
+    return true;
+}
+
+void SimBoard::publish(const ReaderSnapshot &snap)
+{
+    if (shownTap && snap.tapId != shownTap)
+    {
+        taps[shownTap - 1].doneUs = now;
+    }
+    shownTap = snap.tapId;
+    if (!snap.tapId)
+    {
+        return;
+    }
+
+    TapTrace &t = taps[snap.tapId - 1];
+    if (t.feedbackUs < 0)
+    {
+        t.feedbackUs = now;
+    }
+    if (snap.state == STATE_SUCCESS || snap.state == STATE_DENIED)
+    {
+        t.verdictUs = now;
+    }
+}
+
+void SimBoard::run()
+{
+    rngState = 0x2545F491u;
+    taps.assign(sc.taps, TapTrace());
+
+    int64_t t = (int64_t)START_MS * 1000;
+    for (uint32_t i = 0; i < sc.taps; i++)
+    {
+        t += (int64_t)rngRange(sc.gapMs / 2, sc.gapMs + sc.gapMs / 2) * 1000;
+        taps[i].placedUs = t;
+        taps[i].granted = rng() % 100 >= sc.deniedPct;
+        at(t, SIM_CARD_ON, i);
+        at(t + (int64_t)sc.dwellMs * 1000, SIM_CARD_OFF, i);
+    }
+    int64_t endUs = t + (int64_t)DRAIN_MS * 1000;
+
+    fsm.begin();
+    runLed();
+    while (!events.empty() && events.top().atUs <= endUs)
+    {
+        SimEvent ev = events.top();
+        events.pop();
+        now = ev.atUs;
+        dispatch(ev);
+    }
+}
+
+// ======================= REPORT ==========================
+static double percentileMs(std::vector<int64_t> &us, uint32_t pct)
+{
+    if (us.empty())
+    {
+        return 0;
+    }
+    std::sort(us.begin(), us.end());
+    size_t i = ((size_t)us.size() * pct + 99) / 100;
+    return us[i ? i - 1 : 0] / 1000.0;
+}
+
+void SimBoard::report(double hostSeconds) const
+{
+    std::vector<int64_t> feedback, verdict;
+    uint32_t missed = 0, dropped = 0;
+    int64_t lastDoneUs = 0;
+    for (const TapTrace &t : taps)
+    {
+        missed += !t.read;
+        dropped += t.dropped;
+        if (t.feedbackUs >= 0)
+        {
+            feedback.push_back(t.feedbackUs - t.placedUs);
+        }
+        if (t.verdictUs >= 0)
+        {
+            verdict.push_back(t.verdictUs - t.placedUs);
+        }
+        lastDoneUs = max(lastDoneUs, t.doneUs);
+    }
+
+    double minutes = (lastDoneUs - taps.front().placedUs) / 60e6;
+    printf("%-20s %5u %5u %6u %7u %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.2f\n", sc.name,
+           (unsigned)sc.taps, (unsigned)feedback.size(), (unsigned)missed, (unsigned)dropped,
+           percentileMs(feedback, 50), percentileMs(feedback, 95), percentileMs(feedback, 99),
+           percentileMs(feedback, 100), percentileMs(verdict, 50), percentileMs(verdict, 99),
+           minutes > 0 ? feedback.size() / minutes : 0.0, hostSeconds * 1e6 / sc.taps);
+}
+
+// Timeline file from the command line into `out`
+static bool loadTimeline(const char *path, FeedbackTimeline &out)
+{
+    uint8_t image[FEEDBACK_FILE_MAX + 1];
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    size_t size = fread(image, 1, sizeof(image), f);
+    fclose(f);
+    return feedbackTimelineParse(image, size, out);
+}
+
+int main(int argc, char **argv)
+{
+    static FeedbackTimeline fileTimeline;
+    const FeedbackTimeline *timeline = &FEEDBACK_BUILTIN;
+    const char *name = FEEDBACK_FAST_LANE ? "built-in fast lane" : "built-in default";
+    if (argc > 1)
+    {
+        if (!loadTimeline(argv[1], fileTimeline))
+        {
+            fprintf(stderr, "[SIM] %s: missing or malformed timeline\n", argv[1]);
+            return 1;
+        }
+        timeline = &fileTimeline;
+        name = argv[1];
+    }
+
+    const FeedbackKeyframe &green = timeline->keys[timeline->first[TRACK_GRANTED]];
+    printf("[SIM] feedback %s: detected %u ms, granted %u ms, denied %u ms, %s\n", name,
+           (unsigned)feedbackTrackMs(*timeline, TRACK_DETECTED),
+           (unsigned)feedbackTrackMs(*timeline, TRACK_GRANTED),
+           (unsigned)feedbackTrackMs(*timeline, TRACK_DENIED),
+           timeline->length[TRACK_GRANTED] && (green.flags & KF_WAIT_AUDIO)
+               ? "green until the clip ends"
+               : "green for its duration");
+    printf("%-20s %5s %5s %6s %7s %8s %8s %8s %8s %8s %8s %8s %8s\n", "scenario", "taps",
+           "shown", "missed", "dropped", "fb p50", "fb p95", "fb p99", "fb max", "vd p50",
+           "vd p99", "taps/min", "host us");
+
+    for (const Scenario &sc : SCENARIOS)
+    {
+        SimBoard board(sc, *timeline);
+        auto t0 = std::chrono::steady_clock::now();
+        board.run();
+        std::chrono::duration<double> host = std::chrono::steady_clock::now() - t0;
+        board.report(host.count());
+    }
+    return 0;
+}
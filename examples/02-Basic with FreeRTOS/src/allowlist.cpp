@@ -0,0 +1,118 @@
+/**************************************************************************/
+/*!
+    @file     allowlist.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Memory-mapped UID allowlist lookup.
+*/
+/**************************************************************************/
+
+#include "allowlist.h"
+
+#include <esp_partition.h>
+
+static const AllowlistHeader *header = nullptr;
+static const uint8_t *slots = nullptr;
+static uint32_t slotMask = 0;
+
+// Must match tools/build_uidlist.py
+static uint32_t uidHash(const uint8_t *uid, uint8_t uidLength)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    h = (h ^ uidLength) * 16777619u;
+    for (uint8_t i = 0; i < uidLength; i++)
+    {
+        h = (h ^ uid[i]) * 16777619u;
+    }
+    return h;
+}
+
+// A probe for an unknown UID stops at the first empty slot; an image
+// without one is corrupt
+static bool hasEmptySlot(const uint8_t *table, uint32_t slotCount)
+{
+    for (uint32_t i = 0; i < slotCount; i++)
+    {
+        if (table[(size_t)i * ALLOWLIST_SLOT_SIZE] == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool allowlistBegin()
+{
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "uidlist");
+    if (!part)
+    {
+        Serial.println(F("[ALLOW] No uidlist partition"));
+        return false;
+    }
+
+    const void *map = nullptr;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &map, &handle) != ESP_OK)
+    {
+        Serial.println(F("[ALLOW] mmap failed"));
+        return false;
+    }
+
+    const AllowlistHeader *h = (const AllowlistHeader *)map;
+    bool ok = h->magic == ALLOWLIST_MAGIC &&
+              h->version == ALLOWLIST_VERSION &&
+              h->slotSize == ALLOWLIST_SLOT_SIZE &&
+              h->slotCount > 0 && (h->slotCount & (h->slotCount - 1)) == 0 &&
+              h->entryCount < h->slotCount &&
+              sizeof(AllowlistHeader) + (size_t)h->slotCount * ALLOWLIST_SLOT_SIZE <= part->size &&
+              hasEmptySlot((const uint8_t *)map + sizeof(AllowlistHeader), h->slotCount);
+    if (!ok)
+    {
+        spi_flash_munmap(handle);
+        Serial.println(F("[ALLOW] No valid image in uidlist partition"));
+        return false;
+    }
+
+    header = h;
+    slots = (const uint8_t *)map + sizeof(AllowlistHeader);
+    slotMask = h->slotCount - 1;
+
+    Serial.print(F("[ALLOW] "));
+    Serial.print(h->entryCount);
+    Serial.println(F(" UIDs"));
+    return true;
+}
+
+bool allowlistLoaded()
+{
+    return header != nullptr;
+}
+
+uint32_t allowlistSize()
+{
+    return header ? header->entryCount : 0;
+}
+
+bool allowlistContains(const uint8_t *uid, uint8_t uidLength)
+{
+    if (!header || uidLength == 0 || uidLength >= ALLOWLIST_SLOT_SIZE)
+    {
+        return false;
+    }
+
+    // At most one pass over the table, whatever the image holds
+    uint32_t i = uidHash(uid, uidLength) & slotMask;
+    for (uint32_t probes = 0; probes <= slotMask; probes++, i = (i + 1) & slotMask)
+    {
+        const uint8_t *slot = slots + (size_t)i * ALLOWLIST_SLOT_SIZE;
+        if (slot[0] == 0)
+        {
+            return false;
+        }
+        if (slot[0] == uidLength && memcmp(slot + 1, uid, uidLength) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
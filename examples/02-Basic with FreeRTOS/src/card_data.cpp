@@ -0,0 +1,192 @@
+/**************************************************************************/
+/*!
+    @file     card_data.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Ultralight / Classic reads and NDEF parsing.
+*/
+/**************************************************************************/
+
+#include "card_data.h"
+
+#include <Adafruit_PN532.h>
+
+static constexpr uint32_t EXCHANGE_TIMEOUT_MS = 30;
+
+// Tried in order, starting at the sector's cached hint
+static const uint8_t CLASSIC_KEYS[][6] = {
+    {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, // transport
+    {0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7}, // NFC Forum NDEF sectors
+    {0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5}, // MAD
+};
+static constexpr uint8_t CLASSIC_KEY_COUNT = sizeof(CLASSIC_KEYS) / sizeof(CLASSIC_KEYS[0]);
+
+// Ultralight: user memory from page 4, at most this many bytes read
+static constexpr uint8_t UL_FIRST_PAGE = 4;
+static constexpr uint16_t UL_MAX_BYTES = 144; // NTAG213 user area
+
+// ======================= PN532 EXCHANGE ==========================
+// InDataExchange with the current target; returns the card's answer length, or -1
+int CardReader::exchange(const uint8_t *cmd, uint8_t cmdLen, uint8_t *out, uint8_t maxLen)
+{
+    uint8_t frame[2 + 16];
+    uint8_t resp[1 + 16];
+    if (cmdLen > sizeof(frame) - 2 || maxLen > sizeof(resp) - 1)
+    {
+        return -1;
+    }
+    frame[0] = PN532_COMMAND_INDATAEXCHANGE;
+    frame[1] = tg;
+    memcpy(&frame[2], cmd, cmdLen);
+
+    int n = link.transceive(frame, cmdLen + 2, resp, maxLen + 1, EXCHANGE_TIMEOUT_MS);
+    if (n < 1 || (resp[0] & 0x3F) != 0)
+    {
+        return -1; // PN532 / card error (a failed auth halts the card)
+    }
+    memcpy(out, &resp[1], n - 1);
+    return n - 1;
+}
+
+// Wake the card again after a failed authentication. The listing starts
+// over, so look the card up again: with two cards its Tg may change.
+bool CardReader::reselect(const uint8_t *uid, uint8_t uidLength)
+{
+    NfcTarget targets[NFC_MAX_TARGETS];
+    int count = nfcListTargets(link, targets, EXCHANGE_TIMEOUT_MS);
+    for (int i = 0; i < count; i++)
+    {
+        if (targets[i].uidLength == uidLength && memcmp(targets[i].uid, uid, uidLength) == 0)
+        {
+            tg = targets[i].tg;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ======================= ULTRALIGHT / NTAG ==========================
+bool CardReader::readUltralight(CardRecord &out)
+{
+    uint8_t mem[UL_MAX_BYTES];
+    uint16_t have = 0;
+
+    // One READ returns 4 pages; fetch only what the TLV walk needs
+    auto ensure = [&](uint16_t upto) -> bool {
+        while (have < upto)
+        {
+            const uint8_t cmd[] = {MIFARE_CMD_READ, (uint8_t)(UL_FIRST_PAGE + have / 4)};
+            if ((size_t)have + 16 > sizeof(mem) || exchange(cmd, sizeof(cmd), &mem[have], 16) != 16)
+            {
+                return false;
+            }
+            have += 16;
+        }
+        return true;
+    };
+
+    // Skip NULL / lock / memory control TLVs up to the NDEF message TLV
+    uint16_t pos = 0;
+    for (;;)
+    {
+        if (!ensure(pos + 2))
+        {
+            return false;
+        }
+        uint8_t t = mem[pos];
+        if (t == 0x00)
+        {
+            pos++;
+            continue;
+        }
+        if (t == 0xFE)
+        {
+            return false; // terminator: no NDEF message
+        }
+
+        uint16_t len = mem[pos + 1];
+        uint8_t hdr = 2;
+        if (len == 0xFF)
+        {
+            if (!ensure(pos + 4))
+            {
+                return false;
+            }
+            len = (uint16_t)(mem[pos + 2] << 8) | mem[pos + 3];
+            hdr = 4;
+        }
+
+        if (t == 0x03)
+        {
+            // A long message is cut at the read window; the first record
+            // usually fits
+            uint16_t start = pos + hdr;
+            uint16_t avail = min<uint16_t>(len, sizeof(mem) - start);
+            return ensure(start + avail) && ndefParseFirstRecord(&mem[start], avail, out);
+        }
+        pos += hdr + len;
+    }
+}
+
+// ======================= MIFARE CLASSIC ==========================
+bool CardReader::authenticate(const uint8_t *uid, uint8_t sector)
+{
+    uint8_t block = sector * 4;
+    for (uint8_t i = 0; i < CLASSIC_KEY_COUNT; i++)
+    {
+        uint8_t k = (keyHint[sector] + i) % CLASSIC_KEY_COUNT;
+        uint8_t cmd[12] = {MIFARE_CMD_AUTH_A, block};
+        memcpy(&cmd[2], CLASSIC_KEYS[k], 6);
+        memcpy(&cmd[8], uid, 4);
+        uint8_t none[1];
+        if (exchange(cmd, sizeof(cmd), none, 0) == 0)
+        {
+            keyHint[sector] = k;
+            return true;
+        }
+        if (!reselect(uid, 4))
+        {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool CardReader::readClassic(const uint8_t *uid, CardRecord &out)
+{
+    const uint8_t sector = CARD_CLASSIC_SECTOR;
+    if (sector >= CLASSIC_SECTORS || !authenticate(uid, sector))
+    {
+        return false;
+    }
+
+    // Three data blocks, the sector trailer (keys) is skipped
+    for (uint8_t b = 0; b < 3; b++)
+    {
+        const uint8_t cmd[] = {MIFARE_CMD_READ, (uint8_t)(sector * 4 + b)};
+        if (exchange(cmd, sizeof(cmd), &out.data[b * 16], 16) != 16)
+        {
+            return false;
+        }
+    }
+    out.kind = CARD_DATA_CLASSIC;
+    out.length = 48;
+    return true;
+}
+
+// ======================= API ==========================
+bool CardReader::read(const NfcTarget &target, CardRecord &out)
+{
+    out.kind = CARD_DATA_NONE;
+    out.length = 0;
+    tg = target.tg;
+
+    // 7-byte UIDs: Ultralight / NTAG family; 4-byte UIDs: Classic 1K / 4K
+    bool ok = target.uidLength == 7 ? readUltralight(out)
+                                    : target.uidLength == 4 && readClassic(target.uid, out);
+    if (!ok)
+    {
+        out.kind = CARD_DATA_NONE;
+        out.length = 0;
+    }
+    return ok;
+}
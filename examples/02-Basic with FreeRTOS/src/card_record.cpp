@@ -0,0 +1,96 @@
+/**************************************************************************/
+/*!
+    @file     card_record.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    NDEF first-record decoding.
+*/
+/**************************************************************************/
+
+#include "card_record.h"
+
+// ======================= NDEF ==========================
+static const char *const URI_PREFIXES[] = {
+    "", "http://www.", "https://www.", "http://", "https://", "tel:", "mailto:"};
+
+bool ndefParseFirstRecord(const uint8_t *msg, uint16_t len, CardRecord &out)
+{
+    // Header: MB ME CF SR IL TNF(3) | type length | payload length (1 or 4)
+    //         | [id length] | type | [id] | payload
+    if (len < 3)
+    {
+        return false;
+    }
+    uint8_t flags = msg[0];
+    bool shortRecord = flags & 0x10;
+    bool hasId = flags & 0x08;
+    uint8_t tnf = flags & 0x07;
+
+    uint16_t p = 1;
+    uint8_t typeLen = msg[p++];
+    uint32_t payloadLen = 0;
+    if (shortRecord)
+    {
+        payloadLen = msg[p++];
+    }
+    else
+    {
+        if (p + 4 > len)
+        {
+            return false;
+        }
+        payloadLen = ((uint32_t)msg[p] << 24) | ((uint32_t)msg[p + 1] << 16) |
+                     ((uint32_t)msg[p + 2] << 8) | msg[p + 3];
+        p += 4;
+    }
+    uint8_t idLen = 0;
+    if (hasId)
+    {
+        if (p >= len)
+        {
+            return false;
+        }
+        idLen = msg[p++];
+    }
+    // Each field against what is left: a 4-byte payload length taken
+    // from the card must not wrap the sum
+    if (typeLen + idLen > len - p || payloadLen > (uint32_t)(len - p - typeLen - idLen))
+    {
+        return false;
+    }
+    const uint8_t *type = &msg[p];
+    const uint8_t *payload = &msg[p + typeLen + idLen];
+
+    // Well-known types (TNF 1) 'T' and 'U' get unwrapped
+    bool wellKnown = tnf == 0x01 && typeLen == 1;
+    uint8_t n = 0;
+    if (wellKnown && type[0] == 'T' && payloadLen >= 1)
+    {
+        uint8_t langLen = payload[0] & 0x3F;
+        uint32_t skip = 1 + langLen;
+        if (skip > payloadLen)
+        {
+            return false;
+        }
+        n = (uint8_t)min<uint32_t>(payloadLen - skip, CARD_RECORD_MAX);
+        memcpy(out.data, payload + skip, n);
+        out.kind = CARD_DATA_NDEF_TEXT;
+    }
+    else if (wellKnown && type[0] == 'U' && payloadLen >= 1)
+    {
+        uint8_t code = payload[0];
+        const char *prefix = code < sizeof(URI_PREFIXES) / sizeof(URI_PREFIXES[0]) ? URI_PREFIXES[code] : "";
+        uint8_t pl = (uint8_t)min<size_t>(strlen(prefix), CARD_RECORD_MAX);
+        memcpy(out.data, prefix, pl);
+        n = pl + (uint8_t)min<uint32_t>(payloadLen - 1, CARD_RECORD_MAX - pl);
+        memcpy(out.data + pl, payload + 1, n - pl);
+        out.kind = CARD_DATA_NDEF_URI;
+    }
+    else
+    {
+        n = (uint8_t)min<uint32_t>(payloadLen, CARD_RECORD_MAX);
+        memcpy(out.data, payload, n);
+        out.kind = CARD_DATA_NDEF_OTHER;
+    }
+    out.length = n;
+    return true;
+}
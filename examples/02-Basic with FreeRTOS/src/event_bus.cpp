@@ -0,0 +1,65 @@
+/**************************************************************************/
+/*!
+    @file     event_bus.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    FreeRTOS queues behind the reader event bus.
+*/
+/**************************************************************************/
+
+#include "event_bus.h"
+
+#include <esp_timer.h>
+
+static constexpr UBaseType_t EVENT_QUEUE_LEN = 8;
+
+static QueueHandle_t queues[EVT_TARGET_COUNT] = {};
+
+#if STATIC_ALLOC
+static uint8_t queueStorage[EVT_TARGET_COUNT][EVENT_QUEUE_LEN * sizeof(ReaderEvent)];
+static StaticQueue_t queueBufs[EVT_TARGET_COUNT];
+#endif
+
+bool eventBusBegin()
+{
+    for (uint8_t i = 0; i < EVT_TARGET_COUNT; i++)
+    {
+        if (!queues[i])
+        {
+#if STATIC_ALLOC
+            queues[i] = xQueueCreateStatic(EVENT_QUEUE_LEN, sizeof(ReaderEvent),
+                                           queueStorage[i], &queueBufs[i]);
+#else
+            queues[i] = xQueueCreate(EVENT_QUEUE_LEN, sizeof(ReaderEvent));
+#endif
+        }
+        if (!queues[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool eventPost(EventTarget to, const ReaderEvent &ev)
+{
+    return queues[to] && xQueueSend(queues[to], &ev, 0) == pdTRUE;
+}
+
+bool eventPost(EventTarget to, ReaderEventKind kind, uint16_t tapId)
+{
+    ReaderEvent ev = {};
+    ev.kind = kind;
+    ev.tapId = tapId;
+    ev.timestampUs = esp_timer_get_time();
+    return eventPost(to, ev);
+}
+
+bool eventWait(EventTarget self, ReaderEvent &ev, TickType_t timeout)
+{
+    return queues[self] && xQueueReceive(queues[self], &ev, timeout) == pdTRUE;
+}
+
+uint8_t eventPending(EventTarget to)
+{
+    return queues[to] ? (uint8_t)uxQueueMessagesWaiting(queues[to]) : 0;
+}
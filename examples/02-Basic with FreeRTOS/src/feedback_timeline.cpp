@@ -0,0 +1,74 @@
+/**************************************************************************/
+/*!
+    @file     feedback_timeline.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Feedback timeline file validation.
+*/
+/**************************************************************************/
+
+#include "feedback_timeline.h"
+
+static constexpr uint8_t KF_KNOWN = KF_FADE | KF_WAIT_AUDIO;
+
+bool feedbackTimelineParse(const uint8_t *data, size_t size, FeedbackTimeline &out)
+{
+    FeedbackFileHeader h;
+    if (size < sizeof(h))
+    {
+        return false;
+    }
+    memcpy(&h, data, sizeof(h));
+    if (h.magic != FEEDBACK_MAGIC || h.version != FEEDBACK_VERSION || h.idleStepMs == 0)
+    {
+        return false;
+    }
+
+    uint32_t count = 0;
+    for (uint8_t t = 0; t < TRACK_COUNT; t++)
+    {
+        count += h.trackLength[t];
+    }
+    if (count > FEEDBACK_MAX_KEYFRAMES || size != sizeof(h) + count * sizeof(FeedbackKeyframe))
+    {
+        return false;
+    }
+
+    // Check every keyframe first, a bad file leaves `out` as it was
+    const uint8_t *keys = data + sizeof(h);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        FeedbackKeyframe k;
+        memcpy(&k, keys + i * sizeof(k), sizeof(k));
+        bool cueOk = k.cue == FEEDBACK_NO_CUE || k.cue < SOUND_COUNT;
+        bool waitOk = !(k.flags & KF_WAIT_AUDIO) || k.cue != FEEDBACK_NO_CUE;
+        if (!cueOk || !waitOk || (k.flags & ~KF_KNOWN))
+        {
+            return false;
+        }
+    }
+
+    out.idleStepMs = h.idleStepMs;
+    uint8_t first = 0;
+    for (uint8_t t = 0; t < TRACK_COUNT; t++)
+    {
+        out.first[t] = first;
+        out.length[t] = h.trackLength[t];
+        first += h.trackLength[t];
+    }
+    memcpy(out.keys, keys, count * sizeof(FeedbackKeyframe));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        out.keys[i].brightness = min<uint8_t>(out.keys[i].brightness, MAX_BRIGHTNESS);
+    }
+    return true;
+}
+
+uint32_t feedbackTrackMs(const FeedbackTimeline &t, FeedbackTrack track)
+{
+    uint32_t ms = 0;
+    for (uint8_t i = 0; i < t.length[track]; i++)
+    {
+        ms += t.keys[t.first[track] + i].durationMs;
+    }
+    return ms;
+}
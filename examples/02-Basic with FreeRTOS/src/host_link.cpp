@@ -0,0 +1,93 @@
+/**************************************************************************/
+/*!
+    @file     host_link.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Binary tap stream to the access controller.
+*/
+/**************************************************************************/
+
+#include "host_link.h"
+
+#if HOST_LINK
+
+#include "latency_trace.h"
+
+#if HOST_LINK == 1
+static Print &port = Serial1;
+#else
+static Print &port = Serial;
+#endif
+
+static uint16_t nextSeq = 0; // only touched by the Auth task
+static uint32_t sent = 0;
+static uint32_t dropped = 0;
+
+static uint16_t crc16(const uint8_t *p, size_t n)
+{
+    uint16_t crc = 0xFFFF;
+    while (n--)
+    {
+        crc ^= (uint16_t)*p++ << 8;
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t clampUs(uint32_t us)
+{
+    return us > 0xFFFF ? 0xFFFF : (uint16_t)us;
+}
+
+void hostLinkBegin()
+{
+#if HOST_LINK == 1
+    // The driver's TX ring is what makes write() return at once
+    Serial1.setTxBufferSize(HOST_LINK_TX_BUF);
+    Serial1.begin(HOST_LINK_BAUD, SERIAL_8N1, HOST_UART_RX, HOST_UART_TX);
+#endif
+}
+
+bool hostLinkSendTap(uint16_t tapId, uint8_t result, const uint8_t *uid, uint8_t uidLength,
+                     uint8_t cardData)
+{
+    HostTapFrame f = {};
+    f.sync[0] = HOST_SYNC_0;
+    f.sync[1] = HOST_SYNC_1;
+    f.version = HOST_FRAME_VERSION;
+    f.type = HOST_FRAME_TAP;
+    f.seq = nextSeq++;
+    f.tapId = tapId;
+    f.uptimeMs = millis();
+    f.result = result;
+    f.uidLength = min<uint8_t>(uidLength, sizeof(f.uid));
+    memcpy(f.uid, uid, f.uidLength);
+    f.cardData = cardData;
+
+    uint32_t uidUs = latencySinceRf(tapId, LAT_UID_READ);
+    uint32_t dataUs = latencySinceRf(tapId, LAT_CARD_DATA);
+    f.uidReadUs = clampUs(uidUs);
+    f.cardDataUs = dataUs > uidUs ? clampUs(dataUs - uidUs) : 0;
+    f.decisionUs = clampUs(latencySinceRf(tapId, LAT_EVENT_POST));
+    f.crc = crc16((const uint8_t *)&f, offsetof(HostTapFrame, crc));
+
+    // All or nothing: a partial frame would only cost the host a resync
+    if (port.availableForWrite() < (int)sizeof(f))
+    {
+        dropped++;
+        return false;
+    }
+    port.write((const uint8_t *)&f, sizeof(f));
+    sent++;
+    return true;
+}
+
+void hostLinkReport(Print &out)
+{
+    out.printf("[HOST] %s, %u frames sent, %u dropped\n",
+               HOST_LINK == 1 ? "UART" : "USB CDC", (unsigned)sent, (unsigned)dropped);
+}
+
+#endif // HOST_LINK
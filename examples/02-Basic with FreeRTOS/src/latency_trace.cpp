@@ -0,0 +1,125 @@
+/**************************************************************************/
+/*!
+    @file     latency_trace.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Lock-free per-tap latency ring and percentile report.
+*/
+/**************************************************************************/
+
+#include "latency_trace.h"
+
+#if LATENCY_TRACE
+
+#include <esp_timer.h>
+
+// esp_timer is shared by both cores (CCOUNT is per core), 1 us resolution
+static constexpr uint16_t TRACE_SLOTS = 128;
+
+struct TapTrace
+{
+    volatile uint16_t id; // 0 while (re)initialised
+    volatile uint32_t t[LAT_STAGE_COUNT];
+};
+
+static TapTrace ring[TRACE_SLOTS];
+static uint16_t nextId = 0; // only touched by the NFC task
+
+static const char *const STAGE_NAMES[LAT_STAGE_COUNT] = {
+    "rf_detect", "uid_read", "card_data", "event_post", "led_wake",
+    "ramp_start", "success", "audio_start", "first_sample"};
+
+uint16_t latencyBeginTap(uint32_t rfTimeUs)
+{
+    if (++nextId == 0)
+    {
+        nextId = 1;
+    }
+
+    TapTrace &tr = ring[nextId % TRACE_SLOTS];
+    tr.id = 0;
+    for (uint8_t s = 0; s < LAT_STAGE_COUNT; s++)
+    {
+        tr.t[s] = 0;
+    }
+    tr.t[LAT_RF_DETECT] = rfTimeUs;
+    __atomic_store_n(&tr.id, nextId, __ATOMIC_RELEASE);
+    return nextId;
+}
+
+void latencyMark(uint16_t tapId, LatencyStage stage)
+{
+    if (tapId == 0)
+    {
+        return;
+    }
+    TapTrace &tr = ring[tapId % TRACE_SLOTS];
+    if (__atomic_load_n(&tr.id, __ATOMIC_ACQUIRE) == tapId)
+    {
+        uint32_t now = (uint32_t)esp_timer_get_time();
+        tr.t[stage] = now ? now : 1; // 0 means "not reached"
+    }
+}
+
+uint32_t latencySinceRf(uint16_t tapId, LatencyStage stage)
+{
+    if (tapId == 0)
+    {
+        return 0;
+    }
+    TapTrace &tr = ring[tapId % TRACE_SLOTS];
+    uint32_t t0 = tr.t[LAT_RF_DETECT];
+    uint32_t ts = tr.t[stage];
+    if (ts == 0 || __atomic_load_n(&tr.id, __ATOMIC_ACQUIRE) != tapId)
+    {
+        return 0;
+    }
+    return ts - t0;
+}
+
+static void sortU32(uint32_t *v, uint16_t n)
+{
+    for (uint16_t i = 1; i < n; i++)
+    {
+        uint32_t x = v[i];
+        uint16_t j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+        {
+            v[j] = v[j - 1];
+        }
+        v[j] = x;
+    }
+}
+
+void latencyReport(Print &out)
+{
+    static uint32_t deltas[TRACE_SLOTS]; // console task only
+
+    out.println(F("[LAT] us after rf_detect: stage  n  p50  p99  max"));
+    for (uint8_t s = LAT_UID_READ; s < LAT_STAGE_COUNT; s++)
+    {
+        uint16_t n = 0;
+        for (uint16_t i = 0; i < TRACE_SLOTS; i++)
+        {
+            TapTrace &tr = ring[i];
+            uint16_t id = __atomic_load_n(&tr.id, __ATOMIC_ACQUIRE);
+            uint32_t t0 = tr.t[LAT_RF_DETECT];
+            uint32_t ts = tr.t[s];
+            if (id == 0 || ts == 0 || __atomic_load_n(&tr.id, __ATOMIC_ACQUIRE) != id)
+            {
+                continue; // never reached, or slot recycled while reading
+            }
+            deltas[n++] = ts - t0;
+        }
+        if (n == 0)
+        {
+            continue;
+        }
+
+        sortU32(deltas, n);
+        out.printf("  %-12s %4u %8u %8u %8u\n", STAGE_NAMES[s], (unsigned)n,
+                   (unsigned)deltas[(n - 1) / 2], (unsigned)deltas[(n * 99 - 1) / 100],
+                   (unsigned)deltas[n - 1]);
+    }
+}
+
+#endif // LATENCY_TRACE
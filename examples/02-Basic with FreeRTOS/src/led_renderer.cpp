@@ -0,0 +1,165 @@
+/**************************************************************************/
+/*!
+    @file     led_renderer.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Dirty-flag / frame-diff LED renderer on top of FastLED, with
+              an optional asynchronous double-buffered RMT output.
+*/
+/**************************************************************************/
+
+#include "led_renderer.h"
+
+static constexpr TickType_t FRAME_TICKS =
+    pdMS_TO_TICKS(1000 / LED_TARGET_FPS) > 0 ? pdMS_TO_TICKS(1000 / LED_TARGET_FPS) : 1;
+
+#if LED_OUTPUT_ASYNC_RMT
+// WS2812 bit timings in RMT ticks (80 MHz APB / 2 -> 25 ns per tick)
+static constexpr uint8_t RMT_CLK_DIV = 2;
+static constexpr uint16_t T0H = 16; // 0.40 us
+static constexpr uint16_t T0L = 34; // 0.85 us
+static constexpr uint16_t T1H = 32; // 0.80 us
+static constexpr uint16_t T1L = 18; // 0.45 us
+
+static const rmt_item32_t BIT0 = {{{T0H, 1, T0L, 0}}};
+static const rmt_item32_t BIT1 = {{{T1H, 1, T1L, 0}}};
+
+static void encodeByte(rmt_item32_t *out, uint8_t v)
+{
+    for (uint8_t bit = 0; bit < 8; bit++, v <<= 1)
+    {
+        out[bit] = (v & 0x80) ? BIT1 : BIT0; // MSB first
+    }
+}
+#endif
+
+void LedRenderer::begin()
+{
+#if LED_OUTPUT_ASYNC_RMT
+    rmt_config_t cfg = RMT_DEFAULT_CONFIG_TX((gpio_num_t)LED_PIN, LED_RMT_CHANNEL);
+    cfg.clk_div = RMT_CLK_DIV;
+    rmt_config(&cfg);
+    rmt_driver_install(cfg.channel, 0, 0);
+#else
+    FastLED.addLeds<LED_TYPE, LED_PIN>(pixels, NUM_LEDS);
+#endif
+    fill_solid(pixels, NUM_LEDS, CRGB::Black);
+    brightness = MAX_BRIGHTNESS;
+    dirty = true;
+    show(); // strip state is unknown at power-up: always clear it once
+}
+
+#if LED_OUTPUT_ASYNC_RMT
+bool LedRenderer::show()
+{
+    // Encode into the buffer that is not on the wire
+    rmt_item32_t *out = rmtItems[backBuffer];
+    for (uint8_t i = 0; i < NUM_LEDS; i++)
+    {
+        CRGB c = pixels[i];
+        c.nscale8(brightness);
+        encodeByte(out + i * 24, c.g); // NEOPIXEL wire order is GRB
+        encodeByte(out + i * 24 + 8, c.r);
+        encodeByte(out + i * 24 + 16, c.b);
+    }
+
+    // Previous frame still going out: keep this one pending
+    if (rmt_wait_tx_done(LED_RMT_CHANNEL, 0) != ESP_OK)
+    {
+        return false;
+    }
+    rmt_write_items(LED_RMT_CHANNEL, out, RMT_ITEMS, false);
+    backBuffer ^= 1;
+
+    memcpy(onStrip, pixels, sizeof(pixels));
+    onStripBrightness = brightness;
+    lastShowTick = xTaskGetTickCount();
+    dirty = false;
+    shown++;
+    return true;
+}
+#else
+bool LedRenderer::show()
+{
+    FastLED.show(brightness);
+    memcpy(onStrip, pixels, sizeof(pixels));
+    onStripBrightness = brightness;
+    lastShowTick = xTaskGetTickCount();
+    dirty = false;
+    shown++;
+    return true;
+}
+#endif
+
+void LedRenderer::fill(const CRGB &c)
+{
+    fill_solid(pixels, NUM_LEDS, c);
+    dirty = true;
+}
+
+void LedRenderer::set(uint8_t index, const CRGB &c)
+{
+    if (index < NUM_LEDS)
+    {
+        pixels[index] = c;
+        dirty = true;
+    }
+}
+
+void LedRenderer::setBrightness(uint8_t b)
+{
+    brightness = b;
+    dirty = true;
+}
+
+void LedRenderer::draw(const fx::Frame &f)
+{
+    static_assert(sizeof(pixels) == NUM_LEDS * 3, "CRGB must be packed RGB");
+    memcpy(pixels, f.rgb, sizeof(pixels));
+    brightness = f.brightness;
+    dirty = true;
+}
+
+bool LedRenderer::unchanged() const
+{
+    return brightness == onStripBrightness &&
+           memcmp(pixels, onStrip, sizeof(pixels)) == 0;
+}
+
+TickType_t LedRenderer::commit()
+{
+    if (!dirty)
+    {
+        return portMAX_DELAY;
+    }
+    if (unchanged())
+    {
+        dirty = false;
+        skipped++;
+        return portMAX_DELAY;
+    }
+
+    TickType_t elapsed = xTaskGetTickCount() - lastShowTick;
+    if (elapsed < FRAME_TICKS)
+    {
+        return FRAME_TICKS - elapsed;
+    }
+
+    return show() ? portMAX_DELAY : 1;
+}
+
+void LedRenderer::flush()
+{
+    if (!dirty)
+    {
+        return;
+    }
+    if (unchanged())
+    {
+        dirty = false;
+        return;
+    }
+#if LED_OUTPUT_ASYNC_RMT
+    rmt_wait_tx_done(LED_RMT_CHANNEL, pdMS_TO_TICKS(5));
+#endif
+    show(); // clears dirty once sent; still busy -> commit() retries
+}
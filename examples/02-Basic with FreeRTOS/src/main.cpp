@@ -5,228 +5,693 @@
     @brief    ESP32-S3 + PN532 (SPI) card reader using FreeRTOS tasks.
               - No Wi-Fi / OTA
               - LED chaser idle
-              - Card detected -> yellow ramp 2s
-              - Play /success.mp3 + green LEDs
+              - Card detection via PN532 IRQ line (or polling, see NFC_USE_IRQ)
+              - Card detected -> yellow ramp 2s (or short "fast lane" ramp);
+                colours, durations and cues can be replaced by a feedback
+                timeline file on LittleFS, no reflash needed
+              - UID checked against the flash allowlist -> red if denied;
+                with NFC_MAX_TARGETS 2 a wallet of two badges is listed in
+                one scan and the allowlisted one is used
+              - Pipelined mode keeps reading during feedback, queues taps and
+                ignores a card left resting on the reader
+              - Stages RF acquire -> authorize -> feedback / log run as
+                separate tasks joined by lock-free rings, spread over both
+                cores (TASK_PROFILE 2)
+              - Granted / denied / error clips from the sound bank + LEDs
+                (pre-decoded PCM cache on LittleFS/PSRAM, SD + decoder
+                only as fallback)
               - If no SD (or audio can't start) -> returns to idle automatically
+              - Fast boot: PN532 bring-up and SD / sound bank load run in
+                parallel, the reader is live before the SD is mounted
 */
 /**************************************************************************/
 
 #include <Arduino.h>
 #include <SPI.h>
 #include <SD.h>
+#include <LittleFS.h>
 #include <FastLED.h>
 #include <Adafruit_PN532.h>
 #include <Audio.h>
+#include <esp_timer.h>
 #include "config.h"
+#include "pcm_cache.h"
+#include "sound_bank.h"
+#include "event_bus.h"
+#include "led_renderer.h"
+#include "uid_cache.h"
+#include "allowlist.h"
+#include "latency_trace.h"
+#include "task_profile.h"
+#include "tap_log.h"
+#include "shared_state.h"
+#include "pn532_link.h"
+#include "nfc_power.h"
+#include "nfc_targets.h"
+#include "nfc_health.h"
+#include "spsc_ring.h"
+#include "card_data.h"
+#include "spi_bus.h"
+#include "read_ahead.h"
+#include "reader_fsm.h"
+#include "feedback_timeline.h"
+#include "metrics.h"
+#include "static_alloc.h"
+#include "host_link.h"
 
 // ======================= GLOBAL OBJECTS ==========================
-CRGB leds[NUM_LEDS];
+static LedRenderer leds;
 Audio audio;
 
 // SD uses its own SPI pins (from config.h)
 SPIClass &SPI_SD = SPI;
+static SpiBus sdBus(SPI_SD);
 
+#if NFC_SHARED_SPI_BUS
+// PN532 on the SD pins with its own CS; the arbiter keeps it ahead of SD
+SPIClass &SPI_NFC = SPI_SD;
+static SpiBus &nfcBus = sdBus;
+#else
 // PN532 uses a separate SPI bus to avoid conflicts with SD/audio.
 SPIClass SPI_NFC(HSPI);
+static SpiBus nfcBus(SPI_NFC);
+#endif
 
-// PN532 (SPI) on SPI_NFC
+// PN532 (SPI) on SPI_NFC; the raw link carries what the driver lacks
 Adafruit_PN532 nfc(PN532_SS, &SPI_NFC);
-
-// ======================= STATE ==========================
-static volatile ReaderState state = STATE_IDLE;
-
-// UID buffer
-static uint8_t uid[7];
-static uint8_t uidLength = 0;
-
-// SD status
-static bool sdOk = false;
+static Pn532Link nfcLink(SPI_NFC, PN532_SS);
+static CardReader cardReader(nfcLink);
 
 // Audio 
 const int targetVol = 21;
 
-// Effect parameters
-static constexpr uint16_t CHASER_INTERVAL_MS = 120;
-static const CRGB CHASER_COLOR = CRGB::Blue;
-static constexpr uint8_t CHASER_DIM = 22;
+// Player for the pre-decoded clips of the sound bank
+static PcmPlayer pcmPlayer;
 
-static int8_t chaserIndex = 0;
-static int8_t chaserDir = 1;
+// Decoder fallback reads through the PSRAM read-ahead (set before the
+// audio task starts)
+static bool sdReadAhead = false;
 
 // ======================= RTOS HANDLES ==========================
 static TaskHandle_t taskLedHandle = nullptr;
 static TaskHandle_t taskNfcHandle = nullptr;
 static TaskHandle_t taskAudioHandle = nullptr;
+static TaskHandle_t taskAuthHandle = nullptr;
 
-// Task notifications (bit flags)
-static constexpr uint32_t EVT_CARD_DETECTED = (1u << 0);
-static constexpr uint32_t EVT_PLAY_SUCCESS = (1u << 1);
-static constexpr uint32_t EVT_AUDIO_DONE = (1u << 2);
+// Longest a bounded (duty-cycled) scan may take to answer
+static constexpr uint32_t NFC_SCAN_TIMEOUT_MS = 50;
 
-// For timing inside LED task
-static TickType_t stateStartTick = 0;
+// Gap between reads while pipelined (the de-dup cache absorbs repeats)
+static constexpr uint32_t NFC_RETAP_GAP_MS = 20;
+static UidCache uidCache(UID_DEDUP_MS);
 
 // ======================= HELPERS ==========================
 static inline TickType_t msToTicks(uint32_t ms) { return pdMS_TO_TICKS(ms); }
 
-static void setAllLeds(const CRGB &c)
+// ======================= READER CORE ==========================
+// The state machine lives in reader_fsm.cpp; these connect it to the board.
+// It is only driven from the LED task, other tasks read the state through
+// shared_state.h.
+class BoardClock : public ReaderClock
+{
+public:
+    int64_t nowUs() override { return esp_timer_get_time(); }
+};
+
+class StripLeds : public ReaderLeds
+{
+public:
+    void fill(uint32_t rgb, uint8_t brightness) override
+    {
+        leds.setBrightness(brightness);
+        leds.fill(CRGB(rgb));
+        leds.commit();
+    }
+    void draw(const fx::Frame &f) override { leds.draw(f); }
+};
+
+class BankAudio : public ReaderAudio
+{
+public:
+    // Ask the audio task for a clip; false if the bank has no way to play
+    // it or the audio queue is full
+    bool play(SoundId sound, uint16_t tapId) override
+    {
+        if (!soundAvailable(sound))
+        {
+            return false;
+        }
+        ReaderEvent ev = {};
+        ev.kind = EVT_PLAY_SOUND;
+        ev.sound = sound;
+        ev.tapId = tapId;
+        ev.timestampUs = esp_timer_get_time();
+        return eventPost(EVT_TO_AUDIO, ev);
+    }
+};
+
+class BoardTrace : public ReaderTrace
+{
+public:
+    void publish(const ReaderSnapshot &snap) override { sharedStatePublish(snap); }
+    void mark(uint16_t tapId, LatencyStage stage) override { latencyMark(tapId, stage); }
+};
+
+static BoardClock boardClock;
+static StripLeds stripLeds;
+static BankAudio bankAudio;
+static BoardTrace boardTrace;
+static ReaderFsm reader(boardClock, stripLeds, bankAudio, boardTrace);
+
+// ======================= FEEDBACK TIMELINE ==========================
+// Filled by the storage task before EVT_TIMELINE_LOADED, read-only after
+static FeedbackTimeline loadedTimeline;
+static const FeedbackTimeline *activeTimeline = &FEEDBACK_BUILTIN;
+static const char *timelineSource = "built-in";
+
+// Whole file into `buf`; 0 if missing or larger than any valid timeline
+static size_t readTimelineImage(fs::FS &fs, uint8_t *buf)
 {
-    fill_solid(leds, NUM_LEDS, c);
-    FastLED.show();
+    if (!fs.exists(FEEDBACK_TIMELINE_PATH))
+    {
+        return 0;
+    }
+    fs::File f = fs.open(FEEDBACK_TIMELINE_PATH, FILE_READ);
+    size_t size = f ? f.size() : 0;
+    size_t n = size <= FEEDBACK_FILE_MAX ? f.read(buf, size) : 0;
+    f.close();
+    return n == size ? n : 0;
 }
 
-static void changeState(ReaderState newState)
+// The LittleFS copy, unless the SD card holds a different one: that is
+// installed over it (a new timeline only needs a card swap). Parsed
+// once, here; runs in the storage task.
+static void loadTimeline(bool sdOk, bool fsOk)
 {
-    state = newState;
-    stateStartTick = xTaskGetTickCount();
+    uint8_t image[FEEDBACK_FILE_MAX];
+    size_t size = fsOk ? readTimelineImage(LittleFS, image) : 0;
+    bool fromSd = false;
+
+    if (sdOk)
+    {
+        uint8_t sdImage[FEEDBACK_FILE_MAX];
+        size_t sdSize;
+        {
+            SpiBusLock bus(sdBus, SPI_PRIO_CONTROL);
+            sdSize = readTimelineImage(SD, sdImage);
+        }
+        if (sdSize && (sdSize != size || memcmp(sdImage, image, size) != 0))
+        {
+            memcpy(image, sdImage, sdSize);
+            size = sdSize;
+            fromSd = true;
+        }
+    }
+
+    if (size == 0)
+    {
+        return; // no file anywhere, keep the built-in timeline
+    }
+    if (!feedbackTimelineParse(image, size, loadedTimeline))
+    {
+        Serial.println(F("[FB] Bad timeline file, keeping the built-in one"));
+        return;
+    }
+    if (fromSd && fsOk)
+    {
+        fs::File f = LittleFS.open(FEEDBACK_TIMELINE_PATH, FILE_WRITE);
+        if (!f || f.write(image, size) != size)
+        {
+            Serial.println(F("[FB] Could not install the SD timeline on LittleFS"));
+        }
+        f.close();
+    }
+
+    activeTimeline = &loadedTimeline;
+    timelineSource = fromSd ? "SD" : "LittleFS";
+    eventPost(EVT_TO_LED, EVT_TIMELINE_LOADED);
 }
 
-static void resetToIdle()
+static void timelineReport(Print &out)
 {
-    FastLED.setBrightness(MAX_BRIGHTNESS);
-    setAllLeds(CRGB::Black);
-    chaserIndex = 0;
-    chaserDir = 1;
-    changeState(STATE_IDLE);
+    const FeedbackTimeline &t = *activeTimeline;
+    out.printf("[FB] %s timeline: detected %u ms, granted %u ms, denied %u ms, idle step %u ms\n",
+               timelineSource, (unsigned)feedbackTrackMs(t, TRACK_DETECTED),
+               (unsigned)feedbackTrackMs(t, TRACK_GRANTED),
+               (unsigned)feedbackTrackMs(t, TRACK_DENIED), (unsigned)t.idleStepMs);
 }
 
-static void errorState()
+// ======================= TASKS ==========================
+static void TaskLEDState(void *param)
 {
-    FastLED.setBrightness(MAX_BRIGHTNESS);
-    setAllLeds(CRGB::Red);
-    changeState(STATE_ERROR);
+    (void)param;
+    reader.begin();
+
+    for (;;)
+    {
+        // State machine: draw what is due and learn when the next frame is
+        uint32_t waitMs = reader.step();
+        TickType_t wait = waitMs == ReaderFsm::WAIT_FOREVER ? portMAX_DELAY : msToTicks(waitMs);
+
+        // Push the frame (only if it changed); a frame held back by the
+        // FPS cap shortens the wait so it goes out on time
+        TickType_t frameWait = leds.commit();
+        if (frameWait < wait)
+        {
+            wait = frameWait;
+        }
+
+        // Sleep until the next event or the next animation deadline. A
+        // timeout more than a frame past the deadline is a missed frame.
+        ReaderEvent ev;
+        TickType_t waitStart = xTaskGetTickCount();
+        if (!eventWait(EVT_TO_LED, ev, wait))
+        {
+            if (wait != portMAX_DELAY &&
+                xTaskGetTickCount() - waitStart > wait + msToTicks(1000 / LED_TARGET_FPS))
+            {
+                metricsCount(MET_LED_LATE);
+            }
+            continue;
+        }
+
+        if (ev.kind == EVT_CARD_DETECTED)
+        {
+            latencyMark(ev.tapId, LAT_LED_WAKE);
+            ReaderTap tap = {};
+            tap.tapId = ev.tapId;
+            tap.granted = ev.result == RESULT_GRANTED;
+            tap.uidLength = min<uint8_t>(ev.uidLength, sizeof(tap.uid));
+            memcpy(tap.uid, ev.uid, tap.uidLength);
+            if (!reader.onCard(tap))
+            {
+                Serial.println(F("[CARD] Tap queue full, dropped"));
+            }
+        }
+        else if (ev.kind == EVT_READER_FAULT)
+        {
+            reader.onFault();
+        }
+        else if (ev.kind == EVT_READER_OK)
+        {
+            reader.onRecovered();
+        }
+        else if (ev.kind == EVT_AUDIO_DONE)
+        {
+            reader.onAudioDone((SoundId)ev.sound);
+        }
+        else if (ev.kind == EVT_TIMELINE_LOADED)
+        {
+            reader.setTimeline(loadedTimeline);
+        }
+    }
 }
 
-static void transitionToSuccess()
+static void reportCard(AccessResult result, const uint8_t *uid, uint8_t uidLength,
+                       const CardRecord &card, uint16_t tapId)
 {
-    // Show green immediately
-    FastLED.setBrightness(MAX_BRIGHTNESS);
-    setAllLeds(CRGB::Green);
+#if HOST_LINK != 2
+    Serial.print(F("[CARD] UID length="));
+    Serial.print(uidLength);
+    Serial.print(result == RESULT_GRANTED ? F(" granted") : F(" denied"));
+    if (card.kind == CARD_DATA_NDEF_TEXT || card.kind == CARD_DATA_NDEF_URI)
+    {
+        Serial.printf(" \"%.*s\"", (int)card.length, (const char *)card.data);
+    }
+    else if (card.kind != CARD_DATA_NONE)
+    {
+        Serial.printf(" data=%u bytes", (unsigned)card.length);
+    }
+    Serial.println();
+#endif
 
-    // If no SD, do not block in SUCCESS waiting for audio that will never run
-    if (!sdOk)
+    ReaderEvent ev = {};
+    ev.kind = EVT_CARD_DETECTED;
+    ev.result = result;
+    ev.timestampUs = esp_timer_get_time();
+    ev.uidLength = uidLength;
+    memcpy(ev.uid, uid, uidLength);
+    ev.tapId = tapId;
+    ev.card = card;
+    latencyMark(tapId, LAT_EVENT_POST);
+    eventPost(EVT_TO_LED, ev);
+}
+
+// ======================= PIPELINE ==========================
+// RF acquire (NFC task) -> authorize (Auth task) -> feedback (LED task,
+// event bus) and log (tap log ring). Only the RF stage touches the PN532,
+// only the Auth stage decides.
+
+// What the RF stage hands over: the new cards of one scan, and the data
+// of the first of them
+struct TapCapture
+{
+    uint16_t tapId;
+    uint8_t count;
+    NfcTarget targets[NFC_MAX_TARGETS];
+    CardRecord card; // targets[0]'s
+};
+
+// NFC task -> Auth task
+static SpscRing<TapCapture, 4> authInbox;
+
+// RF stage, called after every successful scan with the `count` cards it
+// listed; `rfTimeUs` is when the PN532 reported them. Returns how long the
+// NFC task should pause before the next scan.
+static TickType_t onCardRead(const NfcTarget *targets, uint8_t count, uint32_t rfTimeUs)
+{
+    // Every listed card restarts its dedup window; only new ones are taps
+    TapCapture cap = {};
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < count; i++)
     {
-        vTaskDelay(msToTicks(250)); // small visual confirmation
-        resetToIdle();
-        return;
+        if (uidCache.accept(targets[i].uid, targets[i].uidLength, now))
+        {
+            cap.targets[cap.count++] = targets[i];
+        }
+    }
+    if (cap.count == 0)
+    {
+        return msToTicks(NFC_RETAP_GAP_MS); // same card(s) still on the reader
+    }
+
+    cap.tapId = latencyBeginTap(rfTimeUs);
+    latencyMark(cap.tapId, LAT_UID_READ);
+
+    // Card data of the first new card only, in the same RF session: a
+    // failed Classic auth re-lists the field, which would leave another
+    // card's Tg stale
+#if CARD_DATA
+    cardReader.read(cap.targets[0], cap.card);
+    latencyMark(cap.tapId, LAT_CARD_DATA);
+#endif
+
+    if (authInbox.push(cap))
+    {
+        xTaskNotifyGive(taskAuthHandle);
+    }
+    else
+    {
+        metricsCount(MET_AUTH_DROP);
+    }
+    return msToTicks(NFC_PIPELINED ? NFC_RETAP_GAP_MS : 300);
+}
+
+static bool uidAllowed(const NfcTarget &t)
+{
+    return allowlistLoaded() ? allowlistContains(t.uid, t.uidLength) : !ALLOWLIST_REQUIRED;
+}
+
+// Authorize stage: of the new cards the first allowlisted one is served,
+// else the first; then feedback, host frame and log record. Only the first
+// card's data was read, another card is served without it.
+static void authorize(const TapCapture &cap)
+{
+    uint8_t served = 0;
+    bool allowed = false;
+    for (uint8_t i = 0; i < cap.count && !allowed; i++)
+    {
+        allowed = uidAllowed(cap.targets[i]);
+        served = allowed ? i : 0;
+    }
+    const NfcTarget &t = cap.targets[served];
+    CardRecord card = {};
+    if (served == 0)
+    {
+        card = cap.card;
     }
 
-    // Ask audio task to start playback; LED task will wait for EVT_AUDIO_DONE
-    xTaskNotify(taskAudioHandle, EVT_PLAY_SUCCESS, eSetBits);
-    changeState(STATE_SUCCESS);
+    bool granted = allowed && (!CARD_DATA_REQUIRED || card.kind != CARD_DATA_NONE);
+    AccessResult result = granted ? RESULT_GRANTED : RESULT_DENIED;
+    reportCard(result, t.uid, t.uidLength, card, cap.tapId);
+    hostLinkSendTap(cap.tapId, result, t.uid, t.uidLength, card.kind);
+    tapLogAppend(t.uid, t.uidLength, result);
 }
 
-// ======================= LED EFFECTS (non-blocking) ==========================
-static void runChaserStep()
+static void TaskAuth(void *param)
 {
-    static TickType_t lastStepTick = 0;
-    TickType_t now = xTaskGetTickCount();
+    (void)param;
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        TapCapture cap;
+        while (authInbox.pop(cap))
+        {
+            authorize(cap);
+        }
+    }
+}
+
+// ======================= NFC POLLING / POWER ==========================
+static NfcPollPolicy pollPolicy;
+static bool pollDutyCycled = false;
+
+// Switch between continuous search and bounded scans when the policy says
+// so. Returns true while duty-cycled.
+static bool updatePollMode()
+{
+    uint32_t now = millis();
+    if (sharedStateCurrent() != STATE_IDLE)
+    {
+        pollPolicy.onActivity(now);
+    }
+    bool duty = pollPolicy.dutyCycled(now);
+    if (duty != pollDutyCycled)
+    {
+        // MxRtyPassiveActivation: 0xFF searches until a card shows up
+        {
+            SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+            nfc.setPassiveActivationRetries(duty ? NFC_SCAN_RETRIES : 0xFF);
+        }
+        pollDutyCycled = duty;
+        Serial.println(duty ? F("[NFC] Idle, duty-cycling the field") : F("[NFC] Continuous search"));
+    }
+    return duty;
+}
 
-    if ((now - lastStepTick) >= msToTicks(CHASER_INTERVAL_MS))
+// Field off until the next scan. In IRQ mode an RF wake-up notifies the
+// task early, otherwise the sleep runs its course.
+static void sleepBetweenScans()
+{
+    nfcLink.abort(); // a scan that did not answer in time is still pending
+    if (!pn532PowerDown(nfcLink, NFC_WAKE_ON_FIELD))
     {
-        CRGB dimColor = CHASER_COLOR;
-        dimColor.nscale8(CHASER_DIM);
-        fill_solid(leds, NUM_LEDS, dimColor);
+        vTaskDelay(msToTicks(pollPolicy.sleepMs(millis())));
+        return;
+    }
+    ulTaskNotifyTake(pdTRUE, 0); // edges of the PowerDown exchange
+    ulTaskNotifyTake(pdTRUE, msToTicks(pollPolicy.sleepMs(millis())));
+
+    SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+    nfc.wakeup();
+}
 
-        leds[chaserIndex] = CHASER_COLOR;
-        FastLED.show();
+// ======================= NFC HEALTH ==========================
+static NfcHealth nfcHealth;
+static bool nfcFaulted = false; // error shown until the PN532 answers again
 
-        chaserIndex += chaserDir;
-        if (chaserIndex >= (NUM_LEDS - 1) || chaserIndex <= 0)
+// Hard-reset the PN532 and configure it again. Runs in the NFC task (or
+// the init task at boot), the LED and audio tasks keep going meanwhile.
+static bool recoverPn532()
+{
+    int64_t startUs = esp_timer_get_time();
+    bool ok = pn532HardReset(nfcLink);
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - startUs) / 1000);
+    metricsCount(MET_NFC_RESET);
+    nfcHealth.onRecovery(ok, ms);
+    ulTaskNotifyTake(pdTRUE, 0); // IRQ edges of the SAMConfig exchange
+    pollDutyCycled = false;      // reset default: search until a card shows up
+
+    if (ok)
+    {
+        Serial.printf("[PN532] Reset, back after %u ms\n", (unsigned)ms);
+        if (nfcFaulted)
         {
-            chaserDir = -chaserDir;
+            nfcFaulted = false;
+            eventPost(EVT_TO_LED, EVT_READER_OK);
         }
-        lastStepTick = now;
+        return true;
     }
+
+    if (!nfcFaulted)
+    {
+        Serial.println(F("[PN532] Reset failed, retrying"));
+        nfcFaulted = true;
+        eventPost(EVT_TO_LED, EVT_READER_FAULT);
+    }
+    vTaskDelay(msToTicks(NFC_RECOVERY_RETRY_MS));
+    return false;
 }
 
-static void runYellowRamp()
+// Feed every PN532 exchange result to the monitor
+static void nfcExchange(bool ok)
 {
-    const uint32_t RAMP_MS = 2000;
+    if (ok)
+    {
+        nfcHealth.onOk();
+        return;
+    }
+    metricsCount(MET_NFC_FAULT);
+    if (nfcHealth.onFault())
+    {
+        recoverPn532();
+    }
+}
 
-    TickType_t now = xTaskGetTickCount();
-    uint32_t elapsedMs = (uint32_t)((now - stateStartTick) * portTICK_PERIOD_MS);
+#if NFC_USE_IRQ
+static volatile uint32_t irqTimeUs = 0;
 
-    if (elapsedMs <= RAMP_MS)
+// PN532 pulls IRQ low whenever a frame (ACK or response) is ready to be read
+static void IRAM_ATTR onPn532Irq()
+{
+    irqTimeUs = (uint32_t)esp_timer_get_time();
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(taskNfcHandle, &woken);
+    if (woken)
     {
-        uint8_t b = map(elapsedMs, 0, RAMP_MS, MIN_BRIGHTNESS, MAX_BRIGHTNESS);
-        FastLED.setBrightness(b);
-        fill_solid(leds, NUM_LEDS, CRGB::Yellow);
-        FastLED.show();
+        portYIELD_FROM_ISR();
     }
-    else
+}
+
+// Wait for the PN532 IRQ up to `timeoutMs`, feeding the watchdog on the
+// way: the re-arm period may be longer than its timeout
+static bool waitIrq(uint32_t timeoutMs)
+{
+    uint32_t startMs = millis();
+    for (;;)
     {
-        FastLED.setBrightness(MAX_BRIGHTNESS);
-        transitionToSuccess();
+        uint32_t waited = millis() - startMs;
+        if (waited >= timeoutMs)
+        {
+            return false;
+        }
+        uint32_t slice = min<uint32_t>(timeoutMs - waited, NFC_WATCHDOG_SLICE_MS);
+        if (ulTaskNotifyTake(pdTRUE, msToTicks(slice)) > 0)
+        {
+            return true;
+        }
+        nfcWatchdogFeed();
     }
 }
 
-// ======================= TASKS ==========================
-static void TaskLEDState(void *param)
+static void TaskNFC(void *param)
 {
     (void)param;
-    changeState(STATE_IDLE);
+    NfcTarget targets[NFC_MAX_TARGETS];
+    int count = 0;
+
+    // Attach here so the ISR is registered on the same core as this task
+    pinMode(PN532_IRQ, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(PN532_IRQ), onPn532Irq, FALLING);
+    nfcWatchdogBegin();
 
     for (;;)
     {
-        // Consume notifications (non-blocking)
-        uint32_t notif = 0;
-        xTaskNotifyWait(0, UINT32_MAX, &notif, 0);
+        nfcWatchdogFeed();
+        if (!NFC_PIPELINED && sharedStateCurrent() != STATE_IDLE)
+        {
+            vTaskDelay(msToTicks(80));
+            continue;
+        }
+
+        bool duty = updatePollMode();
 
-        if (notif & EVT_CARD_DETECTED)
+        // Arm InListPassiveTarget. Over SPI this returns true only if the
+        // response is already there (card on the reader while arming).
+        // The bus is held for the whole arm: the command frame, the ACK
+        // poll (up to 100 ms, normally a couple) and the ready check. It is
+        // released before the wait for a card, and taken again to read it.
+        NfcArm arm;
         {
-            changeState(STATE_CARD_DETECTED);
+            SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+            arm = nfcArmTargets(nfcLink);
         }
-        if (notif & EVT_AUDIO_DONE)
+        metricsCount(MET_NFC_POLL);
+        nfcExchange(arm != NFC_ARM_FAULT);
+        if (arm == NFC_ARM_FAULT)
         {
-            resetToIdle();
+            continue;
         }
+        bool ready = arm == NFC_ARM_READY;
+        uint32_t rfTimeUs = (uint32_t)esp_timer_get_time();
 
-        // State machine
-        switch (state)
+        // Drop the edge generated by the ACK frame, then check the level so a
+        // response that landed in between is not lost.
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (!ready && digitalRead(PN532_IRQ) == LOW)
         {
-        case STATE_IDLE:
-            runChaserStep();
-            break;
-
-        case STATE_CARD_DETECTED:
-            runYellowRamp();
-            break;
+            ready = true;
+        }
 
-        case STATE_SUCCESS:
-            // Wait for EVT_AUDIO_DONE (or auto return if audio couldn't start)
-            break;
+        // Sleep until the PN532 reports a target (or re-arm after a while).
+        // A bounded scan always answers, with or without a target.
+        if (!ready)
+        {
+            ready = waitIrq(duty ? NFC_SCAN_TIMEOUT_MS : NFC_IRQ_REARM_MS);
+            rfTimeUs = irqTimeUs;
+        }
 
-        case STATE_ERROR:
-            break;
+        count = 0;
+        if (ready)
+        {
+            {
+                SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+                count = nfcReadTargets(nfcLink, targets);
+            }
+            nfcExchange(count >= 0);
+        }
+        else if (duty)
+        {
+            nfcExchange(false); // a bounded scan that never answered
         }
 
-        vTaskDelay(msToTicks(10)); // 100 Hz
+        if (count > 0)
+        {
+            metricsCount(MET_NFC_HIT);
+            pollPolicy.onActivity(millis());
+            vTaskDelay(onCardRead(targets, count, rfTimeUs));
+        }
+        else if (duty)
+        {
+            sleepBetweenScans();
+        }
     }
 }
-
+#else
 static void TaskNFC(void *param)
 {
     (void)param;
+    NfcTarget targets[NFC_MAX_TARGETS];
+    nfcWatchdogBegin();
 
     for (;;)
     {
-        if (state == STATE_IDLE)
+        nfcWatchdogFeed();
+        if (NFC_PIPELINED || sharedStateCurrent() == STATE_IDLE)
         {
-            uint8_t success = nfc.readPassiveTargetID(
-                PN532_MIFARE_ISO14443A, uid, &uidLength, 50);
-
-            if (success)
+            bool duty = updatePollMode();
+            int count;
             {
-                Serial.print(F("[CARD] UID length="));
-                Serial.println(uidLength);
+                // Held for the whole blocking scan; prefer NFC_USE_IRQ on a shared bus
+                SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+                count = nfcListTargets(nfcLink, targets, duty ? NFC_SCAN_TIMEOUT_MS : 50);
+            }
+            metricsCount(MET_NFC_POLL);
+            nfcExchange(count >= 0);
 
-                xTaskNotify(taskLedHandle, EVT_CARD_DETECTED, eSetBits);
-                vTaskDelay(msToTicks(300));
+            if (count > 0)
+            {
+                metricsCount(MET_NFC_HIT);
+                pollPolicy.onActivity(millis());
+                vTaskDelay(onCardRead(targets, count, (uint32_t)esp_timer_get_time()));
+            }
+            else if (duty)
+            {
+                sleepBetweenScans();
             }
             else
             {
-                vTaskDelay(msToTicks(40));
+                vTaskDelay(msToTicks(taskProfile(TASK_NFC).periodMs));
             }
         }
         else
@@ -235,75 +700,253 @@ static void TaskNFC(void *param)
         }
     }
 }
+#endif
+
+// Volume ramp for the Audio (decoder) fallback, advanced by the service
+// loop so audio.loop() keeps feeding the decoder while it fades in
+struct VolumeFade
+{
+    bool active = false;
+    uint32_t startMs = 0;
+    uint8_t level = 0;
+
+    void start(uint32_t nowMs)
+    {
+        active = true;
+        startMs = nowMs;
+        level = 0;
+        audio.setVolume(0);
+    }
+
+    // Next service deadline while fading, portMAX_DELAY once done
+    TickType_t service(uint32_t nowMs)
+    {
+        if (!active)
+        {
+            return portMAX_DELAY;
+        }
+        uint32_t t = nowMs - startMs;
+        uint8_t v = t >= AUDIO_FADE_MS ? targetVol : (uint8_t)((t * targetVol) / AUDIO_FADE_MS);
+        if (v != level)
+        {
+            level = v;
+            audio.setVolume(v);
+        }
+        active = v < targetVol;
+        return active ? msToTicks(AUDIO_FADE_MS / targetVol + 1) : portMAX_DELAY;
+    }
+};
+
+// Decoder input fill for the metrics. A pass that finds it empty while
+// a clip is decoding (past its first pass) and its file is not read to
+// the end yet is an underrun, counted once per dry spell.
+static uint8_t audioInPct = 0;
+
+static void sampleDecoderBuffer(bool decoding)
+{
+    static bool dry = false;
+    uint32_t filled = audio.inBufferFilled();
+    uint32_t size = filled + audio.inBufferFree();
+    audioInPct = size ? (uint8_t)(filled * 100 / size) : 0;
+    bool empty = filled == 0 && audio.getFilePos() < audio.getFileSize();
+    if (decoding && empty && !dry)
+    {
+        metricsCount(MET_AUDIO_UNDERRUN);
+    }
+    dry = empty;
+}
+
+static void postAudioDone(SoundId sound)
+{
+    ReaderEvent ev = {};
+    ev.kind = EVT_AUDIO_DONE;
+    ev.sound = sound;
+    ev.timestampUs = esp_timer_get_time();
+    eventPost(EVT_TO_LED, ev);
+}
 
 static void TaskAudio(void *param)
 {
     (void)param;
 
+    const TickType_t servicePeriod = msToTicks(taskProfile(TASK_AUDIO).periodMs);
+    VolumeFade fade;
     bool wasRunning = false;
 
+    audioInPct = 0;
+
+    // Through the read-ahead the decoder never touches SPI itself
+    fs::FS &audioFs = sdReadAhead ? readAheadFS() : SD;
+    SpiBus *audioBus = sdReadAhead ? nullptr : &sdBus;
+    SoundId playing = SOUND_GRANTED; // clip reported in EVT_AUDIO_DONE
+    uint16_t playingTap = 0; // latency trace id until the first sample is out
+    bool decoding = false;   // decoder clip open and past its first pass
+
     for (;;)
     {
         if (audio.isRunning())
         {
-            audio.loop();
+            {
+                // Direct SD: one decode pass = one batch of SD reads, behind
+                // any PN532 frame
+                SpiBusLock bus(audioBus, SPI_PRIO_BULK);
+                audio.loop();
+            }
+            sampleDecoderBuffer(decoding);
+            decoding = true;
+            // First decode pass after connecttoFS() queues the first samples
+            latencyMark(playingTap, LAT_FIRST_SAMPLE);
+            playingTap = 0;
         }
-
-        // Handle play requests
-        uint32_t notif = 0;
-        xTaskNotifyWait(0, UINT32_MAX, &notif, 0);
-
-        if (notif & EVT_PLAY_SUCCESS)
+        pcmPlayer.service();
+        if (pcmPlayer.outputStarted())
         {
+            latencyMark(playingTap, LAT_FIRST_SAMPLE);
+            playingTap = 0;
+        }
+        TickType_t fadeWait = fade.service(millis());
 
-            audio.setVolume(0);
-            vTaskDelay(pdMS_TO_TICKS(10));
+        // Handle play requests; sleep indefinitely when nothing is playing
+        ReaderEvent ev;
+        TickType_t wait = wasRunning ? servicePeriod : portMAX_DELAY;
+        if (fadeWait < wait)
+        {
+            wait = fadeWait;
+        }
+        bool play = eventWait(EVT_TO_AUDIO, ev, wait) && ev.kind == EVT_PLAY_SOUND &&
+                    ev.sound < SOUND_COUNT;
+        SoundId sound = play ? (SoundId)ev.sound : playing;
+        const char *sdPath = play ? soundSdPath(sound) : nullptr;
 
-            audio.connecttoFS(SD, "/success.mp3");
+        if (play && wasRunning)
+        {
+            // Cut in: one clip at a time, the interrupted one still reports
+            // its end (a restart of the same clip does not)
+            if (sound != playing)
+            {
+                postAudioDone(playing);
+            }
+            pcmPlayer.stop();
+            if (audio.isRunning())
+            {
+                SpiBusLock bus(audioBus, SPI_PRIO_CONTROL);
+                audio.stopSong();
+            }
+            decoding = false;
+            wasRunning = false;
+        }
 
-            vTaskDelay(pdMS_TO_TICKS(20));
+        if (play && pcmPlayer.start(soundClip(sound), targetVol, AUDIO_FADE_MS))
+        {
+            playing = sound;
+            latencyMark(ev.tapId, LAT_AUDIO_START);
+            playingTap = ev.tapId;
 
-            if (!audio.isRunning())
+            // Cached PCM: first samples are in the DMA buffers right away
+            pcmPlayer.service();
+            if (pcmPlayer.outputStarted())
             {
-                audio.setVolume(targetVol);
-                xTaskNotify(taskLedHandle, EVT_AUDIO_DONE, eSetBits);
+                latencyMark(playingTap, LAT_FIRST_SAMPLE);
+                playingTap = 0;
+            }
+            wasRunning = true;
+        }
+        else if (play)
+        {
+            // Start silent; the fade runs alongside audio.loop()
+            fade.start(millis());
+            bool opened = false;
+            if (sdPath)
+            {
+                SpiBusLock bus(audioBus, SPI_PRIO_CONTROL);
+                opened = audio.connecttoFS(audioFs, sdPath);
+            }
+            if (opened)
+            {
+                playing = sound;
+                latencyMark(ev.tapId, LAT_AUDIO_START);
+                playingTap = ev.tapId;
+                decoding = false; // its first pass only fills the input
+                wasRunning = true;
             }
             else
             {
-                for (int v = 0; v <= targetVol; v++)
-                {
-                    audio.setVolume(v);
-                    vTaskDelay(pdMS_TO_TICKS(5)); 
-                }
+                fade.active = false;
+                audio.setVolume(targetVol);
+                postAudioDone(sound);
             }
         }
 
         // Detect end of playback
-        bool running = audio.isRunning();
+        bool running = audio.isRunning() || pcmPlayer.isRunning();
         if (wasRunning && !running)
         {
-            xTaskNotify(taskLedHandle, EVT_AUDIO_DONE, eSetBits);
+            audioInPct = 0;
+            decoding = false;
+            fade.active = false;
+            postAudioDone(playing);
         }
         wasRunning = running;
-
-        vTaskDelay(msToTicks(2));
     }
 }
 
-// ======================= SETUP/LOOP ==========================
-void setup()
+// ======================= BOOT ==========================
+// PN532 and storage come up in parallel on their own buses. The reader
+// accepts cards as soon as the PN532 is configured; clips and the tap log
+// follow whenever the SD mount / cache load is done.
+
+static uint32_t bootStartMs = 0;
+
+static void TaskInitNFC(void *param)
 {
-    Serial.begin(115200);
+    (void)param;
 
-    // ----- LEDs -----
-    FastLED.addLeds<LED_TYPE, LED_PIN>(leds, NUM_LEDS);
-    FastLED.setBrightness(MAX_BRIGHTNESS);
-    fill_solid(leds, NUM_LEDS, CRGB::Black);
-    FastLED.show();
+#if !NFC_SHARED_SPI_BUS
+    SPI_NFC.begin(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
+#endif
+
+    pn532ResetBegin();
+    uint32_t version;
+    bool configured;
+    {
+        SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+        nfc.begin();
+        version = nfc.getFirmwareVersion();
+        configured = version && nfc.SAMConfig();
+    }
+    if (!configured)
+    {
+        // Show the fault, then keep resetting: a PN532 that hung across the
+        // reboot (or came up late) brings the lane back without a power cycle
+        Serial.println(F("[PN532] Not found!"));
+        nfcFaulted = true;
+        eventPost(EVT_TO_LED, EVT_READER_FAULT);
+        while (!recoverPn532())
+        {
+            // recoverPn532() already waited NFC_RECOVERY_RETRY_MS
+        }
+        SpiBusLock bus(nfcBus, SPI_PRIO_NFC);
+        version = nfc.getFirmwareVersion();
+    }
+
+    Serial.print(F("[PN532] Found PN5"));
+    Serial.println((version >> 24) & 0xFF, HEX);
+    taskStart(TASK_NFC, TaskNFC, &taskNfcHandle);
+    Serial.printf("[BOOT] Reader up after %u ms\n", (unsigned)(millis() - bootStartMs));
+    vTaskDelete(nullptr);
+}
+
+static void TaskInitStorage(void *param)
+{
+    (void)param;
 
     // ----- SD -----
-    SPI_SD.begin(SPI_SCK, SPI_MISO, SPI_MOSI, SD_CS);
-    sdOk = SD.begin(SD_CS, SPI_SD, 25000000); // 25 MHz
+    SPI_SD.begin(SPI_SCK, SPI_MISO, SPI_MOSI, SD_CS); // no-op if setup() did it
+    bool sdOk;
+    {
+        SpiBusLock bus(sdBus, SPI_PRIO_CONTROL);
+        sdOk = SD.begin(SD_CS, SPI_SD, 25000000); // 25 MHz
+    }
     if (!sdOk)
     {
         Serial.println(F("[SD] Card mount failed"));
@@ -311,36 +954,202 @@ void setup()
     else
     {
         Serial.println(F("[SD] OK"));
+        sdReadAhead = readAheadBegin(SD, &sdBus);
     }
 
     // ----- Audio (I2S) -----
     audio.setPinout(I2S_BCLK, I2S_LRC, I2S_DOUT);
     audio.setVolume(targetVol);
 
-    // ----- PN532 (separate SPI bus) -----
-    SPI_NFC.begin(PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
-    nfc.begin();
+    // ----- Sound bank (decoded once, then no SD on the hot path) -----
+    bool fsOk = pcmCacheBegin();
+    soundBankBegin(SD, sdOk, &sdBus);
 
-    uint32_t version = nfc.getFirmwareVersion();
-    if (!version)
+    // ----- Tap log (same LittleFS partition) -----
+    if (fsOk)
     {
-        Serial.println(F("[PN532] Not found!"));
-        errorState();
+        tapLogBegin();
     }
-    else
+
+    // ----- Feedback timeline (LittleFS, replaced from SD) -----
+    loadTimeline(sdOk, fsOk);
+    timelineReport(Serial);
+
+    taskStart(TASK_AUDIO, TaskAudio, &taskAudioHandle);
+    Serial.printf("[BOOT] Storage up after %u ms\n", (unsigned)(millis() - bootStartMs));
+    vTaskDelete(nullptr);
+}
+
+// Levels for the metrics stream; runs in the metrics task
+static void sampleLevels(MetricsLevels &out)
+{
+    out.ledShown = leds.framesShown();
+    out.ledSkipped = leds.framesSkipped();
+    out.ledQueue = eventPending(EVT_TO_LED);
+    out.audioQueue = eventPending(EVT_TO_AUDIO);
+    out.authQueue = authInbox.size();
+    out.audioInPct = audioInPct;
+    ReadAheadStats ra = readAheadStats();
+    out.readAheadKb = ra.buffered / 1024;
+    out.readAheadStalls = ra.stalls;
+    out.nfcRecoverMs = nfcHealth.lastRecoveryMs();
+}
+
+// ======================= SETUP/LOOP ==========================
+void setup()
+{
+    bootStartMs = millis();
+    Serial.begin(115200);
+
+#if TASK_WDT_TIMEOUT_S
+    // System-wide, opted into in config.h: panic -> reboot on any
+    // subscribed task, the idle tasks included
+    esp_task_wdt_init(TASK_WDT_TIMEOUT_S, true);
+#endif
+
+    // Queues first: every task below may post right away
+    eventBusBegin();
+
+    // Controller output before the NFC task can report a tap
+    hostLinkBegin();
+
+    // PSRAM arena before the storage task carves clips / read-ahead from it
+    psramArenaBegin();
+
+    // ----- LEDs -----
+    leds.begin();
+
+    // ----- Allowlist (memory-mapped, no parsing) -----
+    allowlistBegin();
+
+    // ----- SPI arbitration: SD and PN532 traffic goes through the bus locks -----
+    sdBus.begin();
+    nfcBus.begin();
+    nfcLink.attach(nfcBus);
+#if NFC_SHARED_SPI_BUS
+    // Both CS lines idle high before either init task addresses its device
+    pinMode(SD_CS, OUTPUT);
+    digitalWrite(SD_CS, HIGH);
+    pinMode(PN532_SS, OUTPUT);
+    digitalWrite(PN532_SS, HIGH);
+    SPI_SD.begin(SPI_SCK, SPI_MISO, SPI_MOSI, SD_CS);
+#endif
+
+    // ----- Tasks: LED now, NFC / Audio from their init tasks -----
+    taskStart(TASK_LED, TaskLEDState, &taskLedHandle);
+    taskStart(TASK_AUTH, TaskAuth, &taskAuthHandle); // before the NFC task feeds it
+    metricsBegin(sampleLevels);
+    xTaskCreatePinnedToCore(TaskInitNFC, "InitNFC", 4096, nullptr,
+                            taskProfile(TASK_NFC).priority, nullptr, taskProfile(TASK_NFC).core);
+    xTaskCreatePinnedToCore(TaskInitStorage, "InitStorage", 8192, nullptr,
+                            1, nullptr, taskProfile(TASK_AUDIO).core);
+}
+
+// ======================= SERIAL CONSOLE ==========================
+// One command per line:
+//   lat   -> hot-path latency percentiles
+//   tasks -> task layout and stack high-water marks
+//   log   -> tap log status and the latest records
+//   state -> reader state snapshot
+//   bus   -> worst SPI arbitration wait per priority (then reset)
+//   sd    -> SD read-ahead fill and stall count
+//   metrics [ms] -> one metrics sample, or stream every ms (0 stops)
+//   mem   -> heap and PSRAM (arena) use
+//   host  -> binary host frames sent / dropped
+//   nfc   -> PN532 faults, resets and recovery times
+//   fb    -> feedback timeline in use and its track lengths
+static void handleCommand(const char *cmd)
+{
+    if (strcmp(cmd, "lat") == 0)
     {
-        Serial.print(F("[PN532] Found PN5"));
-        Serial.println((version >> 24) & 0xFF, HEX);
+        latencyReport(Serial);
+    }
+    else if (strcmp(cmd, "tasks") == 0)
+    {
+        taskReport(Serial);
+    }
+    else if (strcmp(cmd, "log") == 0)
+    {
+        tapLogReport(Serial);
+    }
+    else if (strcmp(cmd, "state") == 0)
+    {
+        ReaderSnapshot snap = sharedStateRead();
+        Serial.printf("[STATE] %u for %u ms, tap %u, UID ", (unsigned)snap.state,
+                      (unsigned)((esp_timer_get_time() - snap.sinceUs) / 1000),
+                      (unsigned)snap.tapId);
+        for (uint8_t i = 0; i < snap.uidLength; i++)
+        {
+            Serial.printf("%02X", snap.uid[i]);
+        }
+        Serial.println();
+    }
+    else if (strcmp(cmd, "metrics") == 0)
+    {
+        metricsSample(Serial);
+    }
+    else if (strncmp(cmd, "metrics ", 8) == 0)
+    {
+        metricsSetPeriod(strtoul(cmd + 8, nullptr, 10));
+    }
+    else if (strcmp(cmd, "sd") == 0)
+    {
+        readAheadReport(Serial);
+    }
+    else if (strcmp(cmd, "mem") == 0)
+    {
+        Serial.printf("[MEM] heap %u free, min %u, largest block %u\n",
+                      (unsigned)esp_get_free_heap_size(), (unsigned)esp_get_minimum_free_heap_size(),
+                      (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+        psramReport(Serial);
+    }
+    else if (strcmp(cmd, "nfc") == 0)
+    {
+        Serial.printf("[PN532] %s, %u faults, %u resets, last %u ms, worst %u ms\n",
+                      nfcFaulted ? "faulted" : "ok", (unsigned)metricCounters[MET_NFC_FAULT],
+                      (unsigned)metricCounters[MET_NFC_RESET], (unsigned)nfcHealth.lastRecoveryMs(),
+                      (unsigned)nfcHealth.worstRecoveryMs());
+    }
+    else if (strcmp(cmd, "host") == 0)
+    {
+        hostLinkReport(Serial);
+    }
+    else if (strcmp(cmd, "fb") == 0)
+    {
+        timelineReport(Serial);
+    }
+    else if (strcmp(cmd, "bus") == 0)
+    {
+        sdBus.report(Serial, "sd");
+#if !NFC_SHARED_SPI_BUS
+        nfcBus.report(Serial, "nfc");
+#endif
+    }
+    else if (cmd[0] != '\0')
+    {
+        Serial.print(F("[CMD] Unknown: "));
+        Serial.println(cmd);
     }
-    nfc.SAMConfig();
-
-    // ----- Create tasks -----
-    xTaskCreatePinnedToCore(TaskLEDState, "LEDState", 4096, nullptr, 2, &taskLedHandle, 0);
-    xTaskCreatePinnedToCore(TaskNFC, "NFC", 4096, nullptr, 2, &taskNfcHandle, 0);
-    xTaskCreatePinnedToCore(TaskAudio, "Audio", 8192, nullptr, 5, &taskAudioHandle, 1);
 }
 
 void loop()
 {
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    static char line[32];
+    static uint8_t len = 0;
+
+    while (Serial.available())
+    {
+        char c = (char)Serial.read();
+        if (c == '\r' || c == '\n')
+        {
+            line[len] = '\0';
+            handleCommand(line);
+            len = 0;
+        }
+        else if (len < sizeof(line) - 1)
+        {
+            line[len++] = c;
+        }
+    }
+    vTaskDelay(pdMS_TO_TICKS(50));
 }
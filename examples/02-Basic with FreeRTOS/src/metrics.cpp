@@ -0,0 +1,170 @@
+/**************************************************************************/
+/*!
+    @file     metrics.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Runtime metrics stream on the USB CDC console.
+*/
+/**************************************************************************/
+
+#include "metrics.h"
+
+#include <esp_timer.h>
+#include "task_profile.h"
+#include "static_alloc.h"
+
+uint32_t metricCounters[MET_COUNTER_COUNT] = {};
+
+// Room for every task the core and the sketch create
+static constexpr UBaseType_t MAX_TASKS = 24;
+
+struct RunTime
+{
+    UBaseType_t number; // xTaskNumber
+    uint32_t counter;   // ulRunTimeCounter at the last sample
+};
+
+// Sample state, guarded by sampleLock (stream task and console both sample)
+static SemaphoreHandle_t sampleLock = nullptr;
+static StaticSemaphore_t sampleLockBuf;
+static TaskStatus_t tasks[MAX_TASKS];
+static RunTime lastRun[MAX_TASKS];
+static UBaseType_t lastRunCount = 0;
+static uint32_t lastTotalRun = 0;
+static uint32_t lastCounters[MET_COUNTER_COUNT] = {};
+static int64_t lastSampleUs = 0;
+
+static MetricsLevelsFn levelsFn = nullptr;
+static uint32_t periodMs = METRICS_PERIOD_MS;
+static TaskHandle_t samplerHandle = nullptr;
+
+#if configGENERATE_RUN_TIME_STATS
+static uint32_t lastRunOf(UBaseType_t number)
+{
+    for (UBaseType_t i = 0; i < lastRunCount; i++)
+    {
+        if (lastRun[i].number == number)
+        {
+            return lastRun[i].counter;
+        }
+    }
+    return 0;
+}
+#endif
+
+// Tag values may not contain unescaped spaces, commas or equals signs
+static void printTag(Print &out, const char *s)
+{
+    for (; *s; s++)
+    {
+        if (*s == ' ' || *s == ',' || *s == '=')
+        {
+            out.print('\\');
+        }
+        out.print(*s);
+    }
+}
+
+static void printTasks(Print &out)
+{
+    uint32_t totalRun = 0;
+    UBaseType_t n = uxTaskGetSystemState(tasks, MAX_TASKS, &totalRun);
+
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        const TaskStatus_t &t = tasks[i];
+        out.print(F("task,name="));
+        printTag(out, t.pcTaskName);
+        out.printf(" core=%di,prio=%ui,stack_free=%ui", (int)t.xCoreID,
+                   (unsigned)t.uxCurrentPriority, (unsigned)t.usStackHighWaterMark);
+#if configGENERATE_RUN_TIME_STATS
+        // Share of one core over the interval
+        uint32_t dTotal = totalRun - lastTotalRun;
+        uint32_t dRun = t.ulRunTimeCounter - lastRunOf(t.xTaskNumber);
+        out.printf(",cpu=%.1f", dTotal ? 100.0f * dRun / dTotal : 0.0f);
+#endif
+        out.println();
+    }
+
+    for (UBaseType_t i = 0; i < n; i++)
+    {
+        lastRun[i] = {tasks[i].xTaskNumber, tasks[i].ulRunTimeCounter};
+    }
+    lastRunCount = n;
+    lastTotalRun = totalRun;
+}
+
+void metricsSample(Print &out)
+{
+    if (!sampleLock)
+    {
+        return;
+    }
+    xSemaphoreTake(sampleLock, portMAX_DELAY);
+
+    int64_t nowUs = esp_timer_get_time();
+    float seconds = (nowUs - lastSampleUs) / 1e6f;
+    uint32_t c[MET_COUNTER_COUNT];
+    uint32_t d[MET_COUNTER_COUNT];
+    for (uint8_t i = 0; i < MET_COUNTER_COUNT; i++)
+    {
+        c[i] = __atomic_load_n(&metricCounters[i], __ATOMIC_RELAXED);
+        d[i] = c[i] - lastCounters[i];
+        lastCounters[i] = c[i];
+    }
+    lastSampleUs = nowUs;
+
+    MetricsLevels lv = {};
+    if (levelsFn)
+    {
+        levelsFn(lv);
+    }
+
+    out.printf("reader nfc_pps=%.1f,nfc_hit_pct=%.1f,led_shown=%ui,led_skipped=%ui,"
+               "led_late=%ui,q_auth=%ui,auth_drops=%ui,q_led=%ui,q_audio=%ui,"
+               "audio_in_pct=%ui,dec_underruns=%ui,ra_kb=%ui,ra_stalls=%ui,"
+               "nfc_faults=%ui,nfc_resets=%ui,nfc_recover_ms=%ui,log_fails=%ui,heap=%ui\n",
+               seconds > 0 ? d[MET_NFC_POLL] / seconds : 0.0f,
+               d[MET_NFC_POLL] ? 100.0f * d[MET_NFC_HIT] / d[MET_NFC_POLL] : 0.0f,
+               (unsigned)lv.ledShown, (unsigned)lv.ledSkipped, (unsigned)c[MET_LED_LATE],
+               (unsigned)lv.authQueue, (unsigned)c[MET_AUTH_DROP], (unsigned)lv.ledQueue,
+               (unsigned)lv.audioQueue, (unsigned)lv.audioInPct,
+               (unsigned)c[MET_AUDIO_UNDERRUN], (unsigned)lv.readAheadKb,
+               (unsigned)lv.readAheadStalls, (unsigned)c[MET_NFC_FAULT], (unsigned)c[MET_NFC_RESET],
+               (unsigned)lv.nfcRecoverMs, (unsigned)c[MET_LOG_FAIL],
+               (unsigned)esp_get_free_heap_size());
+    printTasks(out);
+
+    xSemaphoreGive(sampleLock);
+}
+
+// ======================= SAMPLER TASK ==========================
+static void TaskMetrics(void *param)
+{
+    (void)param;
+    for (;;)
+    {
+        // A notification means the period changed: restart the wait
+        uint32_t p = __atomic_load_n(&periodMs, __ATOMIC_RELAXED);
+        if (ulTaskNotifyTake(pdTRUE, p ? pdMS_TO_TICKS(p) : portMAX_DELAY) == 0)
+        {
+            metricsSample(Serial);
+        }
+    }
+}
+
+bool metricsBegin(MetricsLevelsFn levels)
+{
+    levelsFn = levels;
+    sampleLock = rtosMutex(sampleLockBuf);
+    lastSampleUs = esp_timer_get_time();
+    return sampleLock && taskStart(TASK_METRICS, TaskMetrics, &samplerHandle);
+}
+
+void metricsSetPeriod(uint32_t ms)
+{
+    __atomic_store_n(&periodMs, ms, __ATOMIC_RELAXED);
+    if (samplerHandle)
+    {
+        xTaskNotifyGive(samplerHandle);
+    }
+}
@@ -0,0 +1,51 @@
+/**************************************************************************/
+/*!
+    @file     nfc_health.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    PN532 hard reset and re-configuration.
+*/
+/**************************************************************************/
+
+#include "nfc_health.h"
+
+#include <Adafruit_PN532.h> // command constants
+
+// RSTPDN low time and the PN532 start-up after it goes high (oscillator
+// plus firmware boot, a few ms on the PN532; margin for slow clones)
+static constexpr uint32_t RESET_PULSE_MS = 2;
+static constexpr uint32_t RESET_BOOT_MS = 10;
+
+// The first frame after a reset may be lost while the SPI wakes up
+static constexpr uint8_t SAM_ATTEMPTS = 3;
+static constexpr uint32_t SAM_TIMEOUT_MS = 15;
+
+void pn532ResetBegin()
+{
+#if PN532_RESET >= 0
+    pinMode(PN532_RESET, OUTPUT);
+    digitalWrite(PN532_RESET, HIGH);
+#endif
+}
+
+bool pn532HardReset(Pn532Link &link)
+{
+#if PN532_RESET >= 0
+    digitalWrite(PN532_RESET, LOW);
+    delay(RESET_PULSE_MS);
+    digitalWrite(PN532_RESET, HIGH);
+    delay(RESET_BOOT_MS);
+#endif
+    link.abort(); // drop whatever command the old session left pending
+
+    // SAMConfiguration: normal mode, no timeout, IRQ pin used
+    const uint8_t cmd[] = {PN532_COMMAND_SAMCONFIGURATION, 0x01, 0x14, 0x01};
+    uint8_t none[1];
+    for (uint8_t i = 0; i < SAM_ATTEMPTS; i++)
+    {
+        if (link.transceive(cmd, sizeof(cmd), none, sizeof(none), SAM_TIMEOUT_MS) >= 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
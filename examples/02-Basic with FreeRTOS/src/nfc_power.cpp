@@ -0,0 +1,27 @@
+/**************************************************************************/
+/*!
+    @file     nfc_power.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    PN532 PowerDown over the raw frame link.
+*/
+/**************************************************************************/
+
+#include "nfc_power.h"
+
+#include <Adafruit_PN532.h>
+
+// PowerDown WakeUpEnable bits (PN532 user manual, 7.2.11)
+static constexpr uint8_t WAKE_RF = 0x08;
+static constexpr uint8_t WAKE_SPI = 0x20;
+
+bool pn532PowerDown(Pn532Link &link, bool wakeOnField)
+{
+    const uint8_t cmd[] = {
+        PN532_COMMAND_POWERDOWN,
+        (uint8_t)(WAKE_SPI | (wakeOnField ? WAKE_RF : 0)),
+        0x01, // GenerateIRQ: signal the wake-up on the IRQ line
+    };
+    uint8_t status = 0xFF;
+    int n = link.transceive(cmd, sizeof(cmd), &status, 1, 10);
+    return n == 1 && (status & 0x3F) == 0;
+}
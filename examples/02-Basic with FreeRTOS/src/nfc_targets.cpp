@@ -0,0 +1,100 @@
+/**************************************************************************/
+/*!
+    @file     nfc_targets.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    ISO14443A target listing with up to NFC_MAX_TARGETS cards.
+*/
+/**************************************************************************/
+
+#include "nfc_targets.h"
+
+#include <Adafruit_PN532.h> // command constants
+
+// The ACK follows the command within a millisecond or two
+static constexpr uint32_t ACK_TIMEOUT_MS = 100;
+
+// SEL_RES bit 6: ISO14443-4 compliant, an ATS follows the NFCID
+static constexpr uint8_t SEL_RES_ISO14443_4 = 0x20;
+
+// NbTg + per target Tg, SENS_RES(2), SEL_RES, NFCIDLength, NFCID(10), ATS
+static constexpr uint8_t RESP_MAX = 1 + NFC_MAX_TARGETS * (5 + 10 + 32);
+
+static const uint8_t LIST_CMD[] = {
+    PN532_COMMAND_INLISTPASSIVETARGET,
+    NFC_MAX_TARGETS,
+    PN532_MIFARE_ISO14443A, // BrTy: 106 kbps type A
+};
+
+uint8_t nfcParseTargets(const uint8_t *resp, int len, NfcTarget *out)
+{
+    if (len < 1)
+    {
+        return 0;
+    }
+    uint8_t listed = min<uint8_t>(resp[0], NFC_MAX_TARGETS);
+    uint8_t count = 0;
+    int pos = 1;
+    for (uint8_t i = 0; i < listed; i++)
+    {
+        // Tg, SENS_RES (2), SEL_RES, NFCIDLength
+        if (pos + 5 > len)
+        {
+            break;
+        }
+        uint8_t tg = resp[pos];
+        uint8_t selRes = resp[pos + 3];
+        uint8_t idLength = resp[pos + 4];
+        pos += 5;
+        if (pos + idLength > len)
+        {
+            break;
+        }
+        const uint8_t *id = &resp[pos];
+        pos += idLength;
+        if ((selRes & SEL_RES_ISO14443_4) && pos < len)
+        {
+            pos += resp[pos]; // TL counts itself
+        }
+
+        if (idLength == 0 || idLength > sizeof(out[count].uid))
+        {
+            continue;
+        }
+        NfcTarget &t = out[count++];
+        t.tg = tg;
+        t.selRes = selRes;
+        t.uidLength = idLength;
+        memcpy(t.uid, id, idLength);
+    }
+    return count;
+}
+
+NfcArm nfcArmTargets(Pn532Link &link)
+{
+    if (!link.startCommand(LIST_CMD, sizeof(LIST_CMD), ACK_TIMEOUT_MS))
+    {
+        return NFC_ARM_FAULT;
+    }
+    return link.isReady() ? NFC_ARM_READY : NFC_ARM_PENDING;
+}
+
+int nfcReadTargets(Pn532Link &link, NfcTarget *out)
+{
+    uint8_t resp[RESP_MAX];
+    int n = link.readResponse(PN532_COMMAND_INLISTPASSIVETARGET, resp, sizeof(resp));
+    return n < 0 ? -1 : nfcParseTargets(resp, n, out);
+}
+
+int nfcListTargets(Pn532Link &link, NfcTarget *out, uint32_t timeoutMs)
+{
+    if (!link.startCommand(LIST_CMD, sizeof(LIST_CMD), ACK_TIMEOUT_MS))
+    {
+        return -1;
+    }
+    if (!link.waitReady(timeoutMs))
+    {
+        link.abort(); // no card in time, the PN532 is still searching
+        return 0;
+    }
+    return nfcReadTargets(link, out);
+}
@@ -0,0 +1,384 @@
+/**************************************************************************/
+/*!
+    @file     pcm_cache.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Boot-time MP3 -> PCM decode and DMA playback of cached clips.
+*/
+/**************************************************************************/
+
+#include "pcm_cache.h"
+
+#include <LittleFS.h>
+#include <driver/i2s.h>
+#include "mp3_decoder/mp3_decoder.h" // libhelix, bundled with ESP32-audioI2S
+#include "static_alloc.h"
+
+// I2S port installed by the Audio object (its default)
+static constexpr i2s_port_t PCM_I2S_PORT = I2S_NUM_0;
+
+// Cache file layout: PcmHeader followed by interleaved int16 samples
+static constexpr uint32_t PCM_MAGIC = 0x324D4350; // "PCM2"
+
+struct PcmHeader
+{
+    uint32_t magic;
+    uint32_t sourceSize;  // size of the MP3 it was decoded from
+    uint32_t sourceMtime; // ... and its last write time: a replaced clip
+                          // of the same length is decoded again
+    uint32_t sampleRate;
+    uint16_t channels;
+    uint16_t reserved;
+    uint32_t frames;
+};
+
+static constexpr size_t MP3_IN_BUF = 2048;
+static constexpr size_t MP3_MAX_SAMPLES = 1152 * 2; // one frame, stereo
+
+static bool fsOk = false;
+
+// ======================= DECODE ==========================
+static bool decodeToCache(fs::File &mp3, uint32_t mtime, const char *cachePath, SpiBus *srcBus)
+{
+    fs::File out = LittleFS.open(cachePath, FILE_WRITE);
+    if (!out)
+    {
+        return false;
+    }
+
+    PcmHeader hdr = {};
+    hdr.magic = PCM_MAGIC;
+    hdr.sourceSize = mp3.size();
+    hdr.sourceMtime = mtime;
+    out.write((const uint8_t *)&hdr, sizeof(hdr)); // frames patched at the end
+
+#if STATIC_ALLOC
+    // Taken from the arena on the first decode and kept for the next ones;
+    // without PSRAM from internal RAM reserved at build time
+    static uint8_t inFallback[MP3_IN_BUF];
+    static int16_t pcmFallback[MP3_MAX_SAMPLES];
+    static uint8_t *in = (uint8_t *)psramAlloc(MP3_IN_BUF);
+    static int16_t *pcm = (int16_t *)psramAlloc(MP3_MAX_SAMPLES * sizeof(int16_t));
+    if (!in || !pcm)
+    {
+        in = inFallback;
+        pcm = pcmFallback;
+    }
+#else
+    uint8_t *in = (uint8_t *)malloc(MP3_IN_BUF);
+    int16_t *pcm = (int16_t *)malloc(MP3_MAX_SAMPLES * sizeof(int16_t));
+#endif
+    bool ok = in && pcm && MP3Decoder_AllocateBuffers();
+
+    uint8_t *rd = in;
+    int bytesLeft = 0;
+    bool eof = false;
+    bool needData = true;
+
+    while (ok)
+    {
+        // Top up the input window, compacted first
+        if (!eof && (needData || bytesLeft < (int)(MP3_IN_BUF / 2)))
+        {
+            memmove(in, rd, bytesLeft);
+            rd = in;
+            size_t room = MP3_IN_BUF - bytesLeft;
+            if (room > 0)
+            {
+                int got;
+                {
+                    SpiBusLock bus(srcBus, SPI_PRIO_BULK);
+                    got = mp3.read(in + bytesLeft, room);
+                }
+                if (got <= 0)
+                {
+                    eof = true;
+                }
+                else
+                {
+                    bytesLeft += got;
+                }
+            }
+            else if (needData)
+            {
+                // A whole window is more than any frame: this sync word
+                // was a false one, look for the next
+                rd++;
+                bytesLeft--;
+            }
+            needData = false;
+        }
+        if (bytesLeft <= 0)
+        {
+            break;
+        }
+
+        int sync = MP3FindSyncWord(rd, bytesLeft);
+        if (sync < 0)
+        {
+            if (eof)
+            {
+                break;
+            }
+            bytesLeft = 0; // no frame in the window, drop it
+            continue;
+        }
+        rd += sync;
+        bytesLeft -= sync;
+
+        int before = bytesLeft;
+        int err = MP3Decode(rd, &bytesLeft, pcm, 0);
+        rd += before - bytesLeft;
+
+        if (err == ERR_MP3_NONE)
+        {
+            MP3GetLastFrameInfo();
+            int samples = MP3GetOutputSamps();
+            hdr.sampleRate = MP3GetSampRate();
+            hdr.channels = MP3GetChannels();
+            out.write((const uint8_t *)pcm, samples * sizeof(int16_t));
+            hdr.frames += samples / hdr.channels;
+        }
+        else if (err == ERR_MP3_INDATA_UNDERFLOW)
+        {
+            if (eof)
+            {
+                break;
+            }
+            needData = true;
+        }
+        else if (err != ERR_MP3_MAINDATA_UNDERFLOW && bytesLeft > 0)
+        {
+            // Corrupt frame: resync one byte further on
+            rd++;
+            bytesLeft--;
+        }
+    }
+
+    MP3Decoder_FreeBuffers();
+#if !STATIC_ALLOC
+    free(in);
+    free(pcm);
+#endif
+
+    ok = ok && hdr.frames > 0 && hdr.channels > 0;
+    out.seek(0);
+    out.write((const uint8_t *)&hdr, sizeof(hdr));
+    out.close();
+
+    if (!ok)
+    {
+        LittleFS.remove(cachePath);
+    }
+    return ok;
+}
+
+// ======================= CACHE ==========================
+bool pcmCacheBegin()
+{
+    fsOk = LittleFS.begin(true);
+    if (!fsOk)
+    {
+        Serial.println(F("[PCM] LittleFS mount failed"));
+    }
+    return fsOk;
+}
+
+static bool readHeader(const char *cachePath, PcmHeader &hdr)
+{
+    fs::File f = LittleFS.open(cachePath, FILE_READ);
+    if (!f)
+    {
+        return false;
+    }
+    bool ok = f.read((uint8_t *)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+              hdr.magic == PCM_MAGIC && hdr.frames > 0 &&
+              (hdr.channels == 1 || hdr.channels == 2) &&
+              f.size() >= sizeof(hdr) + (size_t)hdr.frames * hdr.channels * sizeof(int16_t);
+    f.close();
+    return ok;
+}
+
+bool pcmCacheLoad(PcmClip &clip, fs::FS &src, bool srcOk,
+                  const char *mp3Path, const char *cachePath, SpiBus *srcBus)
+{
+    clip = PcmClip();
+    if (!fsOk)
+    {
+        return false;
+    }
+
+    PcmHeader hdr;
+    bool cached = readHeader(cachePath, hdr);
+
+    if (srcOk)
+    {
+        fs::File mp3;
+        uint32_t mtime = 0;
+        {
+            SpiBusLock bus(srcBus, SPI_PRIO_CONTROL);
+            mp3 = src.open(mp3Path, FILE_READ);
+            mtime = mp3 ? (uint32_t)mp3.getLastWrite() : 0;
+        }
+        if (mp3 && (!cached || hdr.sourceSize != mp3.size() || hdr.sourceMtime != mtime))
+        {
+            Serial.print(F("[PCM] Decoding "));
+            Serial.println(mp3Path);
+            cached = decodeToCache(mp3, mtime, cachePath, srcBus) && readHeader(cachePath, hdr);
+        }
+        if (mp3)
+        {
+            SpiBusLock bus(srcBus, SPI_PRIO_CONTROL);
+            mp3.close();
+        }
+    }
+    if (!cached)
+    {
+        return false;
+    }
+
+    clip.sampleRate = hdr.sampleRate;
+    clip.channels = hdr.channels;
+    clip.frames = hdr.frames;
+    strlcpy(clip.cachePath, cachePath, sizeof(clip.cachePath));
+
+    // Keep a resident copy when there is PSRAM, otherwise stream from flash
+    size_t bytes = (size_t)hdr.frames * hdr.channels * sizeof(int16_t);
+    if (psramFound())
+    {
+        clip.pcm = (int16_t *)psramAlloc(bytes);
+        fs::File f = LittleFS.open(cachePath, FILE_READ);
+        bool loaded = clip.pcm && f && f.seek(sizeof(PcmHeader)) &&
+                      f.read((uint8_t *)clip.pcm, bytes) == bytes;
+        if (!loaded)
+        {
+            psramFree(clip.pcm);
+            clip.pcm = nullptr;
+        }
+    }
+    if (!clip.pcm)
+    {
+        clip.file = LittleFS.open(cachePath, FILE_READ);
+    }
+
+    clip.valid = true;
+    Serial.print(F("[PCM] "));
+    Serial.print(cachePath);
+    Serial.print(F(" ready, "));
+    Serial.print(hdr.frames);
+    Serial.println(clip.pcm ? F(" frames in PSRAM") : F(" frames on LittleFS"));
+    return true;
+}
+
+// ======================= PLAYER ==========================
+bool PcmPlayer::start(const PcmClip &c, uint8_t volume, uint16_t fadeMs)
+{
+    stop();
+    if (!c.valid)
+    {
+        return false;
+    }
+    if (!c.pcm)
+    {
+        if (c.file)
+        {
+            in = &c.file;
+        }
+        else
+        {
+            ownFile = LittleFS.open(c.cachePath, FILE_READ);
+            in = &ownFile;
+        }
+        if (!*in || !in->seek(sizeof(PcmHeader)))
+        {
+            stop();
+            return false;
+        }
+    }
+
+    clip = &c;
+    pos = 0;
+    gain = (uint16_t)((min<uint8_t>(volume, 21) * 256u) / 21u);
+    fadeFrames = (uint32_t)((uint64_t)c.sampleRate * fadeMs / 1000u);
+    chunkBytes = chunkSent = 0;
+    started = false;
+
+    i2s_set_clk(PCM_I2S_PORT, c.sampleRate, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+    running = true;
+    return true;
+}
+
+void PcmPlayer::stop()
+{
+    if (ownFile)
+    {
+        ownFile.close();
+    }
+    in = nullptr;
+    running = false;
+    clip = nullptr;
+}
+
+// Stage the next CHUNK_FRAMES as stereo int16 with gain applied
+bool PcmPlayer::fillChunk()
+{
+    uint32_t n = min<uint32_t>(CHUNK_FRAMES, clip->frames - pos);
+    if (n == 0)
+    {
+        return false;
+    }
+
+    size_t srcSamples = n * clip->channels;
+    if (clip->pcm)
+    {
+        memcpy(chunk, clip->pcm + (size_t)pos * clip->channels, srcSamples * sizeof(int16_t));
+    }
+    else if (in->read((uint8_t *)chunk, srcSamples * sizeof(int16_t)) != srcSamples * sizeof(int16_t))
+    {
+        return false;
+    }
+
+    // Expand mono in place from the back, scale every sample (ramped
+    // per frame while inside the fade-in)
+    bool fading = pos < fadeFrames;
+    for (int32_t i = (int32_t)n - 1; i >= 0; i--)
+    {
+        int32_t g = gain;
+        if (fading && pos + i < fadeFrames)
+        {
+            g = (int32_t)(((uint32_t)gain * (pos + i)) / fadeFrames);
+        }
+        int16_t l = chunk[i * clip->channels];
+        int16_t r = clip->channels == 2 ? chunk[i * 2 + 1] : l;
+        chunk[i * 2] = (int16_t)(((int32_t)l * g) >> 8);
+        chunk[i * 2 + 1] = (int16_t)(((int32_t)r * g) >> 8);
+    }
+
+    pos += n;
+    chunkBytes = n * 2 * sizeof(int16_t);
+    chunkSent = 0;
+    return true;
+}
+
+void PcmPlayer::service()
+{
+    while (running)
+    {
+        if (chunkSent >= chunkBytes && !fillChunk())
+        {
+            // All samples queued; tx_desc_auto_clear pads the tail with silence
+            stop();
+            return;
+        }
+
+        size_t written = 0;
+        i2s_write(PCM_I2S_PORT, (const uint8_t *)chunk + chunkSent,
+                  chunkBytes - chunkSent, &written, 0);
+        chunkSent += written;
+        started = started || written > 0;
+
+        if (chunkSent < chunkBytes)
+        {
+            return; // DMA full, come back next service()
+        }
+    }
+}
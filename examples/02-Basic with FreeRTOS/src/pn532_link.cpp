@@ -0,0 +1,176 @@
+/**************************************************************************/
+/*!
+    @file     pn532_link.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Raw PN532 frame transport over hardware SPI.
+*/
+/**************************************************************************/
+
+#include "pn532_link.h"
+
+#include <Adafruit_PN532.h> // frame / command constants
+
+static const uint8_t ACK_FRAME[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+// Largest command frame sendCommand() builds. The PN532 takes LEN up to
+// 255, but the longest command sent here is an 18 byte InDataExchange
+// (16 data bytes), so the frame lives on the stack at the size the
+// Adafruit driver uses for its own buffer.
+static constexpr uint8_t MAX_FRAME = 64;
+// DATAWRITE, preamble, 2 start codes, LEN, LCS, TFI ... DCS, postamble
+static constexpr uint8_t FRAME_OVERHEAD = 9;
+
+void Pn532Link::begin()
+{
+    if (arbiter)
+    {
+        arbiter->acquire(SPI_PRIO_NFC);
+    }
+    spi.beginTransaction(SPISettings(clockHz, LSBFIRST, SPI_MODE0));
+    digitalWrite(ss, LOW);
+}
+
+void Pn532Link::end()
+{
+    digitalWrite(ss, HIGH);
+    spi.endTransaction();
+    if (arbiter)
+    {
+        arbiter->release();
+    }
+}
+
+bool Pn532Link::sendCommand(const uint8_t *cmd, uint8_t cmdLen)
+{
+    if (cmdLen == 0 || cmdLen > MAX_FRAME - FRAME_OVERHEAD)
+    {
+        return false;
+    }
+
+    uint8_t frame[MAX_FRAME];
+    uint8_t n = 0;
+    uint8_t len = cmdLen + 1; // + TFI
+    uint8_t sum = PN532_HOSTTOPN532;
+
+    frame[n++] = PN532_SPI_DATAWRITE;
+    frame[n++] = PN532_PREAMBLE;
+    frame[n++] = PN532_STARTCODE1;
+    frame[n++] = PN532_STARTCODE2;
+    frame[n++] = len;
+    frame[n++] = (uint8_t)(~len + 1);
+    frame[n++] = PN532_HOSTTOPN532;
+    for (uint8_t i = 0; i < cmdLen; i++)
+    {
+        frame[n++] = cmd[i];
+        sum += cmd[i];
+    }
+    frame[n++] = (uint8_t)(~sum + 1);
+    frame[n++] = PN532_POSTAMBLE;
+
+    pinMode(ss, OUTPUT);
+    begin();
+    spi.writeBytes(frame, n);
+    end();
+    return true;
+}
+
+bool Pn532Link::isReady()
+{
+    begin();
+    spi.transfer(PN532_SPI_STATREAD);
+    uint8_t status = spi.transfer(0x00);
+    end();
+    return status == PN532_SPI_READY;
+}
+
+bool Pn532Link::readAck()
+{
+    uint8_t ack[sizeof(ACK_FRAME)] = {};
+    begin();
+    spi.transfer(PN532_SPI_DATAREAD);
+    spi.transfer(ack, sizeof(ack));
+    end();
+    return memcmp(ack, ACK_FRAME, sizeof(ACK_FRAME)) == 0;
+}
+
+int Pn532Link::readResponse(uint8_t command, uint8_t *out, uint8_t maxLen)
+{
+    // 00 00 FF LEN LCS D5 CMD+1 payload... DCS 00
+    uint8_t hdr[7] = {};
+    begin();
+    spi.transfer(PN532_SPI_DATAREAD);
+    spi.transfer(hdr, sizeof(hdr));
+
+    uint8_t len = hdr[3];
+    bool ok = hdr[0] == PN532_PREAMBLE && hdr[1] == PN532_STARTCODE1 &&
+              hdr[2] == PN532_STARTCODE2 && (uint8_t)(len + hdr[4]) == 0 &&
+              len >= 2 && hdr[5] == PN532_PN532TOHOST && hdr[6] == (uint8_t)(command + 1);
+
+    // Payload and DCS clocked in as one burst
+    uint8_t body[256] = {};
+    int payload = ok ? len - 2 : 0;
+    if (ok)
+    {
+        spi.transfer(body, payload + 1);
+    }
+    end();
+
+    uint8_t sum = hdr[5] + hdr[6];
+    for (int i = 0; i < payload; i++)
+    {
+        sum += body[i];
+    }
+    uint8_t dcs = body[payload];
+    memcpy(out, body, payload < maxLen ? payload : maxLen);
+
+    if (!ok || (uint8_t)(sum + dcs) != 0)
+    {
+        return -1;
+    }
+    return payload < maxLen ? payload : maxLen;
+}
+
+void Pn532Link::abort()
+{
+    uint8_t frame[1 + sizeof(ACK_FRAME)];
+    frame[0] = PN532_SPI_DATAWRITE;
+    memcpy(frame + 1, ACK_FRAME, sizeof(ACK_FRAME));
+
+    begin();
+    spi.writeBytes(frame, sizeof(frame));
+    end();
+}
+
+bool Pn532Link::waitReady(uint32_t timeoutMs)
+{
+    uint32_t start = millis();
+    while (!isReady())
+    {
+        if (millis() - start >= timeoutMs)
+        {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+bool Pn532Link::startCommand(const uint8_t *cmd, uint8_t cmdLen, uint32_t timeoutMs)
+{
+    return sendCommand(cmd, cmdLen) && waitReady(timeoutMs) && readAck();
+}
+
+int Pn532Link::transceive(const uint8_t *cmd, uint8_t cmdLen,
+                          uint8_t *out, uint8_t maxLen, uint32_t timeoutMs)
+{
+    if (!startCommand(cmd, cmdLen, timeoutMs))
+    {
+        return -1;
+    }
+    if (!waitReady(timeoutMs))
+    {
+        abort();
+        return -1;
+    }
+    return readResponse(cmd[0], out, maxLen);
+}
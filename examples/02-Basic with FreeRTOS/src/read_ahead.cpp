@@ -0,0 +1,532 @@
+/**************************************************************************/
+/*!
+    @file     read_ahead.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    SD read-ahead for the decoder fallback.
+*/
+/**************************************************************************/
+
+#include "read_ahead.h"
+
+#include <FSImpl.h>
+#include "task_profile.h"
+#include "static_alloc.h"
+
+static constexpr uint32_t RING_BYTES = AUDIO_READAHEAD_KB * 1024u;
+static constexpr uint32_t CHUNK_BYTES = AUDIO_READAHEAD_CHUNK_KB * 1024u;
+static_assert(CHUNK_BYTES > 0 && CHUNK_BYTES * 2 <= RING_BYTES,
+              "the read-ahead ring must hold at least two chunks");
+
+// First read after an open / seek: enough for the decoder to parse headers
+// and start, without waiting for a whole chunk
+static constexpr uint32_t PRIME_BYTES = min<uint32_t>(4096u, CHUNK_BYTES);
+
+// Open / seek take an SD round trip on the producer side
+static constexpr TickType_t REQUEST_TIMEOUT = pdMS_TO_TICKS(1000);
+// Longest a read() waits for the producer before returning short
+static constexpr TickType_t STALL_TIMEOUT = pdMS_TO_TICKS(100);
+
+typedef enum : uint8_t
+{
+    REQ_OPEN,
+    REQ_SEEK,
+    REQ_CLOSE
+} RequestKind;
+
+// ======================= SHARED STATE ==========================
+// Guarded by `ctl`. Ring bytes in [rdPos, wrPos) belong to the consumer,
+// the rest to the producer, so the copies themselves run unlocked. A
+// request bumps reqGen; the producer drops any read that straddled it.
+static SemaphoreHandle_t ctl = nullptr;
+static SemaphoreHandle_t dataReady = nullptr; // producer -> consumer
+static StaticSemaphore_t ctlBuf;
+static StaticSemaphore_t dataReadyBuf;
+static TaskHandle_t producer = nullptr;
+static uint8_t *ring = nullptr;
+static fs::FS *srcFs = nullptr;
+static SpiBus *srcBus = nullptr;
+
+static uint32_t reqGen = 0;
+static uint32_t ackGen = 0;
+static RequestKind reqKind = REQ_CLOSE;
+static char reqPath[64];
+static uint32_t reqPos = 0;
+
+static uint32_t stream = 0;     // id of the open stream, 0 -> none
+static uint32_t fileSize = 0;
+static uint32_t rdPos = 0;      // absolute file offsets
+static uint32_t wrPos = 0;
+static bool readError = false;  // SD read / seek failed, stream ends at wrPos
+
+static uint32_t statReads = 0;
+static uint32_t statStalls = 0;
+
+static void lockCtl()
+{
+    xSemaphoreTake(ctl, portMAX_DELAY);
+}
+
+static void unlockCtl()
+{
+    xSemaphoreGive(ctl);
+}
+
+// Consumer side: hand a request to the producer, optionally waiting until
+// it has been applied
+static bool request(RequestKind kind, const char *path, uint32_t pos, bool wait)
+{
+    lockCtl();
+    reqKind = kind;
+    if (path)
+    {
+        strlcpy(reqPath, path, sizeof(reqPath));
+    }
+    reqPos = pos;
+    uint32_t gen = ++reqGen;
+    unlockCtl();
+    xTaskNotifyGive(producer);
+
+    TickType_t start = xTaskGetTickCount();
+    while (wait)
+    {
+        lockCtl();
+        bool done = ackGen == gen;
+        unlockCtl();
+        if (done)
+        {
+            return true;
+        }
+        if (xTaskGetTickCount() - start >= REQUEST_TIMEOUT)
+        {
+            return false;
+        }
+        xSemaphoreTake(dataReady, pdMS_TO_TICKS(10));
+    }
+    return true;
+}
+
+// ======================= PRODUCER ==========================
+static void applyRequest(fs::File &file, RequestKind kind, const char *path, uint32_t pos)
+{
+    static uint32_t nextStream = 0;
+
+    bool ok = true;
+    uint32_t size = fileSize;
+    uint32_t id = stream;
+    {
+        SpiBusLock bus(srcBus, SPI_PRIO_CONTROL);
+        if (kind != REQ_SEEK && file)
+        {
+            file.close();
+        }
+        if (kind == REQ_OPEN)
+        {
+            file = srcFs->open(path, FILE_READ);
+            ok = file && !file.isDirectory();
+            size = ok ? file.size() : 0;
+            id = ok ? ++nextStream : 0;
+        }
+        else if (kind == REQ_SEEK)
+        {
+            ok = file && file.seek(pos);
+        }
+    }
+
+    lockCtl();
+    if (kind == REQ_OPEN)
+    {
+        stream = id;
+        fileSize = size;
+    }
+    rdPos = wrPos = kind == REQ_SEEK ? pos : 0;
+    readError = !ok;
+    unlockCtl();
+}
+
+static void TaskReadAhead(void *param)
+{
+    (void)param;
+    fs::File file;
+    uint32_t gen = 0;
+    bool primed = false;
+
+    for (;;)
+    {
+        lockCtl();
+        if (reqGen != gen)
+        {
+            gen = reqGen;
+            RequestKind kind = reqKind;
+            char path[sizeof(reqPath)];
+            strlcpy(path, reqPath, sizeof(path));
+            uint32_t pos = reqPos;
+            unlockCtl();
+
+            applyRequest(file, kind, path, pos);
+            primed = false;
+
+            lockCtl();
+            ackGen = gen;
+            unlockCtl();
+            xSemaphoreGive(dataReady);
+            continue;
+        }
+
+        // One sequential read per pass: a full chunk, or the tail of the file
+        uint32_t n = 0;
+        uint32_t at = wrPos;
+        if (file && !readError && wrPos < fileSize)
+        {
+            n = min(primed ? CHUNK_BYTES : PRIME_BYTES, fileSize - wrPos);
+            if (RING_BYTES - (wrPos - rdPos) < n)
+            {
+                n = 0; // ring full, wait for the consumer
+            }
+        }
+        unlockCtl();
+
+        if (n == 0)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        uint32_t idx = at % RING_BYTES;
+        uint32_t first = min(n, RING_BYTES - idx);
+        uint32_t got;
+        {
+            SpiBusLock bus(srcBus, SPI_PRIO_BULK);
+            got = file.read(ring + idx, first);
+            if (got == first && n > first)
+            {
+                got += file.read(ring, n - first);
+            }
+        }
+
+        lockCtl();
+        if (reqGen == gen)
+        {
+            wrPos += got;
+            readError = got < n;
+            statReads++;
+            primed = true;
+        }
+        unlockCtl();
+        xSemaphoreGive(dataReady);
+    }
+}
+
+// ======================= CONSUMER (fs::FS view) ==========================
+class RingFile : public fs::FileImpl
+{
+public:
+    RingFile(uint32_t id, const char *p, uint32_t bytes) : id(id), bytes(bytes)
+    {
+        strlcpy(filePath, p, sizeof(filePath));
+    }
+    ~RingFile() override { close(); }
+
+    size_t write(const uint8_t *buf, size_t size) override { return 0; }
+    size_t read(uint8_t *buf, size_t size) override;
+    void flush() override {}
+    bool seek(uint32_t off, fs::SeekMode mode) override;
+    size_t position() const override { return pos; }
+    size_t size() const override { return bytes; }
+    bool setBufferSize(size_t size) override { return false; }
+    void close() override;
+    time_t getLastWrite() override { return 0; }
+    const char *path() const override { return filePath; }
+    const char *name() const override
+    {
+        const char *slash = strrchr(filePath, '/');
+        return slash ? slash + 1 : filePath;
+    }
+    bool isDirectory() override { return false; }
+    fs::FileImplPtr openNextFile(const char *mode) override { return fs::FileImplPtr(); }
+    void rewindDirectory() override {}
+    operator bool() override { return isOpen(); }
+
+    // Directory iteration, not in every core version's FileImpl
+    bool seekDir(long position) { return false; }
+    String getNextFileName() { return String(); }
+    String getNextFileName(bool *isDir) { return String(); }
+
+private:
+    bool isOpen()
+    {
+        lockCtl();
+        bool open = id != 0 && stream == id;
+        unlockCtl();
+        return open;
+    }
+
+    uint32_t id;
+    uint32_t bytes;
+    uint32_t pos = 0;
+    char filePath[sizeof(reqPath)];
+};
+
+size_t RingFile::read(uint8_t *buf, size_t size)
+{
+    size_t done = 0;
+    bool stalled = false;
+    while (done < size)
+    {
+        lockCtl();
+        bool open = id != 0 && stream == id;
+        uint32_t at = rdPos;
+        uint32_t avail = wrPos - rdPos;
+        bool end = readError || wrPos >= fileSize;
+        unlockCtl();
+
+        if (!open)
+        {
+            break;
+        }
+        if (avail == 0)
+        {
+            // Short reads are fine; only wait when there is nothing at all
+            if (end || done > 0)
+            {
+                break;
+            }
+            if (!stalled)
+            {
+                stalled = true;
+                statStalls++;
+            }
+            if (!xSemaphoreTake(dataReady, STALL_TIMEOUT))
+            {
+                break;
+            }
+            continue;
+        }
+
+        uint32_t n = min<uint32_t>(avail, size - done);
+        uint32_t idx = at % RING_BYTES;
+        uint32_t first = min(n, RING_BYTES - idx);
+        memcpy(buf + done, ring + idx, first);
+        memcpy(buf + done + first, ring, n - first);
+
+        lockCtl();
+        rdPos = at + n;
+        unlockCtl();
+        xTaskNotifyGive(producer); // room for the next chunk
+        done += n;
+        pos = at + n;
+    }
+    return done;
+}
+
+bool RingFile::seek(uint32_t off, fs::SeekMode mode)
+{
+    uint32_t target = mode == fs::SeekCur ? pos + off : mode == fs::SeekEnd ? bytes + off : off;
+    if (target > bytes || !isOpen())
+    {
+        return false;
+    }
+
+    // Forward into what is already buffered: no SD access
+    lockCtl();
+    bool buffered = target >= rdPos && target <= wrPos;
+    if (buffered)
+    {
+        rdPos = target;
+    }
+    unlockCtl();
+
+    if (!buffered)
+    {
+        if (!request(REQ_SEEK, nullptr, target, true))
+        {
+            return false;
+        }
+        lockCtl();
+        bool ok = !readError;
+        unlockCtl();
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    xTaskNotifyGive(producer);
+    pos = target;
+    return true;
+}
+
+void RingFile::close()
+{
+    if (!isOpen())
+    {
+        id = 0;
+        return;
+    }
+    lockCtl();
+    stream = 0;
+    unlockCtl();
+    id = 0;
+    request(REQ_CLOSE, nullptr, 0, false);
+}
+
+#if STATIC_ALLOC
+// Open files come from a fixed pool instead of make_shared: the decoder
+// holds the current file and, while reopening, the one it replaces
+static constexpr uint8_t FILE_SLOTS = 2;
+static constexpr size_t FILE_SLOT_BYTES = sizeof(RingFile) + 32; // + control block
+alignas(8) static uint8_t fileSlots[FILE_SLOTS][FILE_SLOT_BYTES];
+static bool fileSlotUsed[FILE_SLOTS] = {};
+
+template <typename T>
+struct FilePool
+{
+    typedef T value_type;
+
+    FilePool() = default;
+    template <typename U>
+    FilePool(const FilePool<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        lockCtl();
+        for (uint8_t i = 0; i < FILE_SLOTS; i++)
+        {
+            if (!fileSlotUsed[i] && bytes <= FILE_SLOT_BYTES)
+            {
+                fileSlotUsed[i] = true;
+                unlockCtl();
+                return (T *)fileSlots[i];
+            }
+        }
+        unlockCtl();
+        return (T *)::operator new(bytes); // more handles than expected
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        for (uint8_t i = 0; i < FILE_SLOTS; i++)
+        {
+            if ((uint8_t *)p == fileSlots[i])
+            {
+                lockCtl();
+                fileSlotUsed[i] = false;
+                unlockCtl();
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const FilePool<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const FilePool<U> &) const { return false; }
+};
+#endif
+
+class RingFS : public fs::FSImpl
+{
+public:
+    fs::FileImplPtr open(const char *path, const char *mode, const bool create) override
+    {
+        if (!ring || strcmp(mode, FILE_READ) != 0 || !request(REQ_OPEN, path, 0, true))
+        {
+            return fs::FileImplPtr();
+        }
+        lockCtl();
+        uint32_t id = stream;
+        uint32_t size = fileSize;
+        unlockCtl();
+        if (!id)
+        {
+            return fs::FileImplPtr();
+        }
+#if STATIC_ALLOC
+        return std::allocate_shared<RingFile>(FilePool<RingFile>(), id, path, size);
+#else
+        return std::make_shared<RingFile>(id, path, size);
+#endif
+    }
+
+    bool exists(const char *path) override
+    {
+        SpiBusLock bus(srcBus, SPI_PRIO_CONTROL);
+        return srcFs && srcFs->exists(path);
+    }
+
+    // Read-only
+    bool rename(const char *pathFrom, const char *pathTo) override { return false; }
+    bool remove(const char *path) override { return false; }
+    bool mkdir(const char *path) override { return false; }
+    bool rmdir(const char *path) override { return false; }
+};
+
+static fs::FS ringFs(std::make_shared<RingFS>());
+
+// ======================= API ==========================
+bool readAheadBegin(fs::FS &src, SpiBus *bus)
+{
+    if (!AUDIO_READAHEAD)
+    {
+        return false;
+    }
+    if (!psramFound())
+    {
+        Serial.println(F("[SD] No PSRAM, decoder reads SD directly"));
+        return false;
+    }
+
+    ring = (uint8_t *)psramAlloc(RING_BYTES);
+    ctl = rtosMutex(ctlBuf);
+    dataReady = rtosBinary(dataReadyBuf);
+    srcFs = &src;
+    srcBus = bus;
+    if (!ring || !ctl || !dataReady || !taskStart(TASK_READAHEAD, TaskReadAhead, &producer))
+    {
+        Serial.println(F("[SD] Read-ahead unavailable"));
+        psramFree(ring);
+        ring = nullptr;
+        return false;
+    }
+
+    Serial.printf("[SD] Read-ahead: %u KB ring, %u KB reads\n",
+                  (unsigned)AUDIO_READAHEAD_KB, (unsigned)AUDIO_READAHEAD_CHUNK_KB);
+    return true;
+}
+
+fs::FS &readAheadFS()
+{
+    return ringFs;
+}
+
+ReadAheadStats readAheadStats()
+{
+    ReadAheadStats st = {};
+    if (ring)
+    {
+        lockCtl();
+        st.buffered = wrPos - rdPos;
+        st.reads = statReads;
+        st.stalls = statStalls;
+        unlockCtl();
+    }
+    return st;
+}
+
+void readAheadReport(Print &out)
+{
+    if (!ring)
+    {
+        out.println(F("[SD] Read-ahead off"));
+        return;
+    }
+    ReadAheadStats st = readAheadStats();
+    lockCtl();
+    uint32_t at = rdPos;
+    uint32_t size = stream ? fileSize : 0;
+    unlockCtl();
+
+    out.printf("[SD] Read-ahead %u/%u KB buffered, at %u of %u, %u reads, %u stalls\n",
+               (unsigned)(st.buffered / 1024), (unsigned)AUDIO_READAHEAD_KB, (unsigned)at,
+               (unsigned)size, (unsigned)st.reads, (unsigned)st.stalls);
+}
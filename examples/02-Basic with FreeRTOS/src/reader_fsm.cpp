@@ -0,0 +1,291 @@
+/**************************************************************************/
+/*!
+    @file     reader_fsm.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Reader state machine, independent of the hardware.
+*/
+/**************************************************************************/
+
+#include "reader_fsm.h"
+
+// Fade frame period
+static constexpr uint32_t FADE_FRAME_MS = 10;
+
+static constexpr uint32_t COLOR_BLACK = 0x000000;
+static constexpr uint32_t COLOR_RED = 0xFF0000;
+
+// ======================= EFFECTS ==========================
+// Tables built at compile time (led_effects.h), kept in flash
+static constexpr uint32_t CHASER_COLOR = 0x0000FF; // blue
+static constexpr uint8_t CHASER_DIM = 22;
+
+static constexpr fx::Chaser<NUM_LEDS, CHASER_COLOR, CHASER_DIM, CHASER_INTERVAL_MS,
+                            MAX_BRIGHTNESS>
+    chaserFx;
+
+// KF_FADE progress 0..255 -> share of the brightness step, gamma 2.2
+static constexpr fx::BrightnessCurve<256, 0, 255> fadeCurve;
+
+// ======================= TRANSITIONS ==========================
+void ReaderFsm::changeState(ReaderState newState)
+{
+    state = newState;
+    stateStartUs = clock.nowUs();
+    waitCue = FEEDBACK_NO_CUE;
+
+    ReaderSnapshot snap = {};
+    snap.state = newState;
+    snap.tapId = newState == STATE_IDLE ? 0 : shown.tapId;
+    snap.uidLength = newState == STATE_IDLE ? 0 : shown.uidLength;
+    memcpy(snap.uid, shown.uid, snap.uidLength);
+    snap.sinceUs = stateStartUs;
+    trace.publish(snap);
+}
+
+void ReaderFsm::fillAll(uint32_t rgb)
+{
+    leds.fill(rgb, MAX_BRIGHTNESS);
+}
+
+void ReaderFsm::resetToIdle()
+{
+    timeline = staged;
+    fillAll(COLOR_BLACK);
+    changeState(STATE_IDLE); // the chaser restarts from LED 0
+}
+
+void ReaderFsm::errorState()
+{
+    fillAll(COLOR_RED);
+    audio.play(SOUND_ERROR, 0);
+    changeState(STATE_ERROR);
+}
+
+void ReaderFsm::deniedState()
+{
+    changeState(STATE_DENIED);
+    enterTrack(TRACK_DENIED);
+}
+
+void ReaderFsm::transitionToSuccess()
+{
+    trace.mark(shown.tapId, LAT_SUCCESS);
+    changeState(STATE_SUCCESS);
+    enterTrack(TRACK_GRANTED);
+}
+
+void ReaderFsm::startTap(const ReaderTap &tap)
+{
+    shown = tap;
+    shown.uidLength = min<uint8_t>(tap.uidLength, sizeof(shown.uid));
+    if (tap.granted)
+    {
+        changeState(STATE_CARD_DETECTED);
+        enterTrack(TRACK_DETECTED);
+    }
+    else
+    {
+        deniedState();
+    }
+}
+
+// Start the next queued tap, if any, otherwise stay idle
+void ReaderFsm::nextTapOrIdle()
+{
+    resetToIdle();
+    if (pendingCount > 0)
+    {
+        ReaderTap tap = pendingTaps[pendingHead];
+        pendingHead = (pendingHead + 1) % PENDING_TAPS;
+        pendingCount--;
+        startTap(tap);
+    }
+}
+
+// ======================= LED EFFECTS (non-blocking) ==========================
+// Each effect returns the ms until it needs to run again
+
+uint32_t ReaderFsm::stateElapsedMs()
+{
+    return (uint32_t)((clock.nowUs() - stateStartUs) / 1000);
+}
+
+// The table steps every CHASER_INTERVAL_MS; the timeline's idle step
+// rescales its clock
+uint32_t ReaderFsm::runChaserStep()
+{
+    uint32_t step = timeline->idleStepMs;
+    fx::Frame f = chaserFx.at((uint32_t)((uint64_t)stateElapsedMs() * CHASER_INTERVAL_MS / step));
+    leds.draw(f);
+    return (f.holdMs * step + CHASER_INTERVAL_MS - 1) / CHASER_INTERVAL_MS;
+}
+
+// ======================= TIMELINE TRACKS ==========================
+void ReaderFsm::enterTrack(FeedbackTrack t)
+{
+    track = t;
+    keyFrom = 0;
+    enterKeyframe(0, stateStartUs);
+}
+
+// Start keyframe `index` of the track at `startUs` (on schedule, not when
+// the LED task got to it) and play its cue
+void ReaderFsm::enterKeyframe(uint8_t index, int64_t startUs)
+{
+    keyIndex = index;
+    keyStartUs = startUs;
+    waitCue = FEEDBACK_NO_CUE;
+    if (index >= timeline->length[track])
+    {
+        return; // track done, runTrack() moves on
+    }
+
+    const FeedbackKeyframe &k = timeline->keys[timeline->first[track] + index];
+    if (k.cue != FEEDBACK_NO_CUE)
+    {
+        // Only wait for a clip that was actually queued: one the bank
+        // can't play, or a full audio queue, falls back to durationMs
+        if (audio.play((SoundId)k.cue, shown.tapId) && (k.flags & KF_WAIT_AUDIO))
+        {
+            waitCue = k.cue;
+        }
+    }
+}
+
+void ReaderFsm::nextKeyframe(int64_t startUs)
+{
+    keyFrom = timeline->keys[timeline->first[track] + keyIndex].brightness;
+    enterKeyframe(keyIndex + 1, startUs);
+}
+
+// Show keyframe `k`, `elapsedMs` into it; returns the ms until it changes
+uint32_t ReaderFsm::drawKeyframe(const FeedbackKeyframe &k, uint32_t elapsedMs)
+{
+    uint32_t rgb = (uint32_t)k.rgb[0] << 16 | (uint32_t)k.rgb[1] << 8 | k.rgb[2];
+    if ((k.flags & KF_FADE) && elapsedMs < k.durationMs)
+    {
+        int32_t span = (int32_t)k.brightness - keyFrom;
+        uint8_t level = keyFrom + span * fadeCurve.level[elapsedMs * 255 / k.durationMs] / 255;
+        leds.fill(rgb, level);
+        return min(FADE_FRAME_MS - elapsedMs % FADE_FRAME_MS, k.durationMs - elapsedMs);
+    }
+
+    leds.fill(rgb, k.brightness);
+    if (waitCue != FEEDBACK_NO_CUE)
+    {
+        return WAIT_FOREVER; // onAudioDone() moves on
+    }
+    return k.durationMs - elapsedMs;
+}
+
+uint32_t ReaderFsm::runTrack()
+{
+    int64_t nowUs = clock.nowUs();
+    while (keyIndex < timeline->length[track])
+    {
+        const FeedbackKeyframe &k = timeline->keys[timeline->first[track] + keyIndex];
+        uint32_t elapsed = (uint32_t)((nowUs - keyStartUs) / 1000);
+        if (waitCue != FEEDBACK_NO_CUE || elapsed < k.durationMs)
+        {
+            if (state == STATE_CARD_DETECTED && rampTapId != shown.tapId)
+            {
+                rampTapId = shown.tapId;
+                trace.mark(shown.tapId, LAT_RAMP_START);
+            }
+            return drawKeyframe(k, elapsed);
+        }
+        nextKeyframe(keyStartUs + (int64_t)k.durationMs * 1000);
+    }
+    return endTrack();
+}
+
+// Detected -> granted; granted / denied -> next tap or IDLE
+uint32_t ReaderFsm::endTrack()
+{
+    if (state == STATE_CARD_DETECTED)
+    {
+        transitionToSuccess();
+    }
+    else
+    {
+        nextTapOrIdle();
+    }
+    return 0; // state changed, re-evaluate right away
+}
+
+// ======================= API ==========================
+void ReaderFsm::begin()
+{
+    if (state != STATE_ERROR)
+    {
+        changeState(STATE_IDLE);
+    }
+}
+
+uint32_t ReaderFsm::step()
+{
+    switch (state)
+    {
+    case STATE_IDLE:
+        return runChaserStep();
+
+    case STATE_CARD_DETECTED:
+    case STATE_SUCCESS:
+    case STATE_DENIED:
+        return runTrack();
+
+    case STATE_ERROR:
+        break;
+    }
+    return WAIT_FOREVER;
+}
+
+bool ReaderFsm::onCard(const ReaderTap &tap)
+{
+    if (state == STATE_IDLE)
+    {
+        startTap(tap);
+        return true;
+    }
+    if (state == STATE_ERROR)
+    {
+        return true; // reader is out of service, nothing to show
+    }
+    if (pendingCount == PENDING_TAPS)
+    {
+        return false;
+    }
+    pendingTaps[(pendingHead + pendingCount) % PENDING_TAPS] = tap;
+    pendingCount++;
+    return true;
+}
+
+void ReaderFsm::onFault()
+{
+    errorState();
+}
+
+void ReaderFsm::onRecovered()
+{
+    if (state == STATE_ERROR)
+    {
+        resetToIdle();
+    }
+}
+
+void ReaderFsm::onAudioDone(SoundId sound)
+{
+    if (waitCue == sound)
+    {
+        nextKeyframe(clock.nowUs()); // step() draws it, or ends the track
+    }
+}
+
+void ReaderFsm::setTimeline(const FeedbackTimeline &t)
+{
+    staged = &t;
+    if (state == STATE_IDLE || state == STATE_ERROR)
+    {
+        timeline = staged;
+    }
+}
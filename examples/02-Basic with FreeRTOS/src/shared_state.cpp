@@ -0,0 +1,45 @@
+/**************************************************************************/
+/*!
+    @file     shared_state.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Seqlock behind the shared reader snapshot.
+*/
+/**************************************************************************/
+
+#include "shared_state.h"
+
+// Even -> stable, odd -> a publish is in progress
+static uint32_t sequence = 0;
+static ReaderSnapshot snapshot = {STATE_IDLE, 0, {0}, 0, 0};
+static ReaderState current = STATE_IDLE;
+
+void sharedStatePublish(const ReaderSnapshot &snap)
+{
+    uint32_t seq = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&sequence, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy((void *)&snapshot, &snap, sizeof(snapshot));
+
+    __atomic_store_n(&sequence, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&current, snap.state, __ATOMIC_RELEASE);
+}
+
+ReaderSnapshot sharedStateRead()
+{
+    ReaderSnapshot copy;
+    uint32_t before, after;
+    do
+    {
+        before = __atomic_load_n(&sequence, __ATOMIC_ACQUIRE);
+        memcpy(&copy, (const void *)&snapshot, sizeof(copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&sequence, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+    return copy;
+}
+
+ReaderState sharedStateCurrent()
+{
+    return __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,55 @@
+/**************************************************************************/
+/*!
+    @file     sound_bank.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Boot-time resolution of the feedback clips.
+*/
+/**************************************************************************/
+
+#include "sound_bank.h"
+
+struct SoundSource
+{
+    const char *mp3Path;   // on SD
+    const char *cachePath; // on LittleFS
+};
+
+static const SoundSource SOURCES[SOUND_COUNT] = {
+    {"/success.mp3", "/success.pcm"},
+    {"/denied.mp3", "/denied.pcm"},
+    {"/expired.mp3", "/expired.pcm"},
+    {"/error.mp3", "/error.pcm"},
+};
+
+static PcmClip clips[SOUND_COUNT];
+static bool onSd[SOUND_COUNT] = {};
+static bool ready = false; // set once, after every slot above is final
+
+void soundBankBegin(fs::FS &sd, bool sdOk, SpiBus *sdBus)
+{
+    for (uint8_t i = 0; i < SOUND_COUNT; i++)
+    {
+        const SoundSource &src = SOURCES[i];
+        {
+            SpiBusLock bus(sdBus, SPI_PRIO_CONTROL);
+            onSd[i] = sdOk && sd.exists(src.mp3Path);
+        }
+        pcmCacheLoad(clips[i], sd, onSd[i], src.mp3Path, src.cachePath, sdBus);
+    }
+    __atomic_store_n(&ready, true, __ATOMIC_RELEASE);
+}
+
+const PcmClip &soundClip(SoundId id)
+{
+    return clips[id];
+}
+
+const char *soundSdPath(SoundId id)
+{
+    return soundAvailable(id) && onSd[id] ? SOURCES[id].mp3Path : nullptr;
+}
+
+bool soundAvailable(SoundId id)
+{
+    return __atomic_load_n(&ready, __ATOMIC_ACQUIRE) && (clips[id].valid || onSd[id]);
+}
@@ -0,0 +1,83 @@
+/**************************************************************************/
+/*!
+    @file     spi_bus.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Priority arbitration for devices sharing one SPI host.
+*/
+/**************************************************************************/
+
+#include "spi_bus.h"
+
+#include <esp_timer.h>
+#include "static_alloc.h"
+
+bool SpiBus::begin()
+{
+    if (!lock)
+    {
+        lock = rtosRecursiveMutex(lockBuf);
+    }
+    return lock != nullptr;
+}
+
+bool SpiBus::higherWaiting(SpiPriority prio) const
+{
+    for (uint8_t p = prio + 1; p < SPI_PRIO_COUNT; p++)
+    {
+        if (__atomic_load_n(&waiting[p], __ATOMIC_RELAXED))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpiBus::acquire(SpiPriority prio)
+{
+    // Nested use (e.g. a link call inside a driver call) just counts up
+    if (xSemaphoreGetMutexHolder(lock) == xTaskGetCurrentTaskHandle())
+    {
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+        return;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    __atomic_add_fetch(&waiting[prio], 1, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+        if (!higherWaiting(prio))
+        {
+            break;
+        }
+        // The mutex wakes waiters by task priority, not bus priority:
+        // hand it back and let the more urgent device in first
+        xSemaphoreGiveRecursive(lock);
+        vTaskDelay(1);
+    }
+    __atomic_sub_fetch(&waiting[prio], 1, __ATOMIC_RELAXED);
+
+    uint32_t waitUs = (uint32_t)(esp_timer_get_time() - t0);
+    if (waitUs > maxWaitUs[prio])
+    {
+        maxWaitUs[prio] = waitUs; // written by the holder only
+    }
+}
+
+void SpiBus::release()
+{
+    xSemaphoreGiveRecursive(lock);
+}
+
+void SpiBus::report(Print &out, const char *name)
+{
+    static const char *const NAMES[SPI_PRIO_COUNT] = {"bulk", "control", "nfc"};
+
+    out.printf("[BUS] %s max wait:", name);
+    for (uint8_t p = 0; p < SPI_PRIO_COUNT; p++)
+    {
+        out.printf(" %s %lu us", NAMES[p], (unsigned long)maxWaitUs[p]);
+        maxWaitUs[p] = 0;
+    }
+    out.println();
+}
@@ -0,0 +1,79 @@
+/**************************************************************************/
+/*!
+    @file     static_alloc.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    PSRAM arena for the zero-heap build option.
+*/
+/**************************************************************************/
+
+#include "static_alloc.h"
+
+// Blocks start on a cache line
+static constexpr size_t ARENA_ALIGN = 32;
+static constexpr size_t ARENA_BYTES = (size_t)PSRAM_ARENA_KB * 1024;
+
+static uint8_t *arena = nullptr;
+static size_t arenaUsed = 0;
+static size_t arenaLast = 0; // offset of the latest block
+static portMUX_TYPE arenaMux = portMUX_INITIALIZER_UNLOCKED;
+
+bool psramArenaBegin()
+{
+    if (!STATIC_ALLOC || arena || !psramFound())
+    {
+        return arena != nullptr;
+    }
+    arena = (uint8_t *)ps_malloc(ARENA_BYTES);
+    if (!arena)
+    {
+        Serial.println(F("[MEM] PSRAM arena unavailable"));
+    }
+    return arena != nullptr;
+}
+
+void *psramAlloc(size_t bytes)
+{
+    if (!STATIC_ALLOC)
+    {
+        return ps_malloc(bytes);
+    }
+
+    void *p = nullptr;
+    size_t size = (bytes + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    portENTER_CRITICAL(&arenaMux);
+    if (arena && size <= ARENA_BYTES - arenaUsed)
+    {
+        p = arena + arenaUsed;
+        arenaLast = arenaUsed;
+        arenaUsed += size;
+    }
+    portEXIT_CRITICAL(&arenaMux);
+    return p;
+}
+
+void psramFree(void *p)
+{
+    if (!STATIC_ALLOC)
+    {
+        free(p);
+        return;
+    }
+
+    portENTER_CRITICAL(&arenaMux);
+    if (p && p == arena + arenaLast)
+    {
+        arenaUsed = arenaLast;
+    }
+    portEXIT_CRITICAL(&arenaMux);
+}
+
+void psramReport(Print &out)
+{
+#if STATIC_ALLOC
+    out.printf("[MEM] PSRAM arena %u KB, %u KB used\n", (unsigned)PSRAM_ARENA_KB,
+               (unsigned)(arenaUsed / 1024));
+#else
+    out.printf("[MEM] PSRAM heap %u KB free\n",
+               (unsigned)(heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / 1024));
+#endif
+}
@@ -0,0 +1,355 @@
+/**************************************************************************/
+/*!
+    @file     tap_log.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    RAM ring -> batched, rotated LittleFS tap log.
+*/
+/**************************************************************************/
+
+#include "tap_log.h"
+
+#if TAP_LOG
+
+#include <LittleFS.h>
+#include "task_profile.h"
+#include "metrics.h"
+
+static_assert(sizeof(TapRecord) == 16, "TapRecord is written to flash as is");
+
+static const char LOG_DIR[] = "/taplog";
+
+// One LittleFS program page per batch
+static constexpr uint16_t PAGE_RECORDS = 256 / sizeof(TapRecord);
+static constexpr uint32_t FILE_RECORDS = (TAP_LOG_FILE_KB * 1024u) / sizeof(TapRecord);
+
+// Single producer (Auth task) / single consumer (writer task)
+static constexpr uint16_t RING_SLOTS = 64;
+static_assert((RING_SLOTS & (RING_SLOTS - 1)) == 0, "RING_SLOTS must be a power of two");
+static TapRecord ring[RING_SLOTS];
+static uint32_t ringHead = 0; // written by the producer
+static uint32_t ringTail = 0; // written by the writer
+static uint32_t dropped = 0;
+
+static TaskHandle_t writerHandle = nullptr;
+static uint16_t bootId = 0;
+
+// Writer task state
+static fs::File logFile;
+static uint32_t fileIndex = 0;   // number of the file being appended
+static uint32_t fileRecords = 0; // records already in it
+static uint32_t written = 0;     // since boot
+static bool rotateFailing = false;
+static bool fileTorn = false;    // a short write left part of a record
+
+// ======================= RECORDS ==========================
+static uint8_t crc8(const uint8_t *p, size_t n)
+{
+    uint8_t crc = 0;
+    while (n--)
+    {
+        crc ^= *p++;
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static bool recordValid(const TapRecord &r)
+{
+    return r.uidLength <= sizeof(r.uid) &&
+           r.crc == crc8((const uint8_t *)&r, offsetof(TapRecord, crc));
+}
+
+static void logPath(char *buf, size_t len, uint32_t index)
+{
+    snprintf(buf, len, "%s/%08u.bin", LOG_DIR, (unsigned)index);
+}
+
+// ======================= FILES ==========================
+// Lowest / highest file number present; false if the directory is empty
+static bool scanFiles(uint32_t &first, uint32_t &last, uint32_t &count)
+{
+    first = UINT32_MAX;
+    last = 0;
+    count = 0;
+    fs::File dir = LittleFS.open(LOG_DIR);
+    if (!dir || !dir.isDirectory())
+    {
+        return false;
+    }
+    for (fs::File f = dir.openNextFile(); f; f = dir.openNextFile())
+    {
+        const char *name = strrchr(f.name(), '/');
+        name = name ? name + 1 : f.name();
+        char *end = nullptr;
+        uint32_t n = strtoul(name, &end, 10);
+        if (end == name || strcmp(end, ".bin") != 0)
+        {
+            continue;
+        }
+        first = min(first, n);
+        last = max(last, n);
+        count++;
+    }
+    return count > 0;
+}
+
+// Walk a file up to its last intact record. Returns the number of intact
+// records; `clean` is false if anything follows them (torn write).
+static uint32_t replayFile(uint32_t index, TapRecord &lastGood, bool &clean)
+{
+    char path[32];
+    logPath(path, sizeof(path), index);
+    fs::File f = LittleFS.open(path, FILE_READ);
+    clean = true;
+    if (!f)
+    {
+        return 0;
+    }
+
+    uint32_t n = 0;
+    TapRecord r;
+    while (f.read((uint8_t *)&r, sizeof(r)) == sizeof(r))
+    {
+        if (!recordValid(r))
+        {
+            clean = false;
+            break;
+        }
+        lastGood = r;
+        n++;
+    }
+    clean = clean && f.position() == f.size();
+    f.close();
+    return n;
+}
+
+// Switch appending to file `index`; on failure the current file (if
+// any) stays open
+static bool openLogFile(uint32_t index)
+{
+    char path[32];
+    logPath(path, sizeof(path), index);
+    fs::File f = LittleFS.open(path, FILE_APPEND);
+    if (!f)
+    {
+        return false;
+    }
+    logFile.close();
+    logFile = f;
+    fileIndex = index;
+    fileRecords = logFile.size() / sizeof(TapRecord);
+    return true;
+}
+
+// Start the next file and drop the oldest ones beyond TAP_LOG_FILES
+static bool rotate()
+{
+    if (!openLogFile(fileIndex + 1))
+    {
+        // Keep the full file; the taps wait in the ring and the next
+        // flush tries again
+        metricsCount(MET_LOG_FAIL);
+        if (!rotateFailing)
+        {
+            Serial.println(F("[LOG] Cannot start the next log file, retrying"));
+        }
+        rotateFailing = true;
+        return false;
+    }
+    rotateFailing = false;
+    fileTorn = false;
+
+    uint32_t first, last, count;
+    while (scanFiles(first, last, count) && count > TAP_LOG_FILES)
+    {
+        char path[32];
+        logPath(path, sizeof(path), first);
+        if (!LittleFS.remove(path))
+        {
+            break;
+        }
+    }
+    return true;
+}
+
+// ======================= WRITER ==========================
+static uint32_t pending()
+{
+    return __atomic_load_n(&ringHead, __ATOMIC_ACQUIRE) - ringTail;
+}
+
+static void flushPending()
+{
+    static TapRecord page[PAGE_RECORDS];
+
+    bool wrote = false;
+    while (logFile && pending() > 0)
+    {
+        // Nothing is appended after a torn record: replay stops there
+        if ((fileRecords >= FILE_RECORDS || fileTorn) && !rotate())
+        {
+            break;
+        }
+
+        // Never let a batch straddle two files
+        uint32_t n = min<uint32_t>(min<uint32_t>(pending(), PAGE_RECORDS),
+                                   FILE_RECORDS - fileRecords);
+        // Boot id and CRC are added here: taps can be queued before the
+        // replay at boot has found the boot id
+        for (uint32_t i = 0; i < n; i++)
+        {
+            TapRecord &r = page[i];
+            r = ring[(ringTail + i) & (RING_SLOTS - 1)];
+            r.bootId = bootId;
+            r.crc = crc8((const uint8_t *)&r, offsetof(TapRecord, crc));
+        }
+
+        // The ring only lets go of the records that reached the file; the
+        // rest are written again on the next flush
+        size_t bytes = n * sizeof(TapRecord);
+        size_t got = logFile.write((const uint8_t *)page, bytes);
+        uint32_t done = got / sizeof(TapRecord);
+        __atomic_store_n(&ringTail, ringTail + done, __ATOMIC_RELEASE);
+        fileRecords += done;
+        written += done;
+        wrote = wrote || done > 0;
+        if (got != bytes)
+        {
+            fileTorn = got % sizeof(TapRecord) != 0;
+            metricsCount(MET_LOG_FAIL);
+            Serial.println(F("[LOG] Write failed"));
+            break;
+        }
+    }
+    if (wrote)
+    {
+        logFile.flush(); // commit the metadata: survives a power cut from here on
+    }
+}
+
+// Wakes on a full page, otherwise every periodMs to flush what is there
+static void TaskTapLog(void *param)
+{
+    (void)param;
+    const TickType_t period = pdMS_TO_TICKS(taskProfile(TASK_LOG).periodMs);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, period);
+        flushPending();
+    }
+}
+
+// ======================= API ==========================
+bool tapLogBegin()
+{
+    if (!LittleFS.exists(LOG_DIR) && !LittleFS.mkdir(LOG_DIR))
+    {
+        Serial.println(F("[LOG] Cannot create log directory"));
+        return false;
+    }
+
+    uint32_t first, last, count;
+    TapRecord lastGood = {};
+    bool clean = true;
+    uint32_t records = 0;
+    if (scanFiles(first, last, count))
+    {
+        records = replayFile(last, lastGood, clean);
+
+        // A just-rotated file is empty: the boot id lives in an older one
+        bool found = records > 0;
+        bool olderClean;
+        for (uint32_t i = last; !found && i > first; i--)
+        {
+            found = replayFile(i - 1, lastGood, olderClean) > 0;
+        }
+        bootId = found ? (uint16_t)(lastGood.bootId + 1) : 0;
+    }
+    else
+    {
+        last = 0;
+    }
+
+    // A torn tail stays where it is; new records go to a fresh file
+    uint32_t index = clean ? last : last + 1;
+    if (!openLogFile(index))
+    {
+        Serial.println(F("[LOG] Cannot open log file"));
+        return false;
+    }
+    if (!clean)
+    {
+        Serial.print(F("[LOG] Torn record after "));
+        Serial.print(records);
+        Serial.println(F(" records, continuing in a new file"));
+    }
+
+    return taskStart(TASK_LOG, TaskTapLog, &writerHandle);
+}
+
+bool tapLogAppend(const uint8_t *uid, uint8_t uidLength, uint8_t result)
+{
+    uint32_t head = ringHead;
+    if (head - __atomic_load_n(&ringTail, __ATOMIC_ACQUIRE) >= RING_SLOTS)
+    {
+        dropped++;
+        return false;
+    }
+
+    TapRecord &r = ring[head & (RING_SLOTS - 1)];
+    r = TapRecord();
+    r.result = result;
+    r.uidLength = min<uint8_t>(uidLength, sizeof(r.uid));
+    r.uptimeMs = millis();
+    memcpy(r.uid, uid, r.uidLength);
+    __atomic_store_n(&ringHead, head + 1, __ATOMIC_RELEASE);
+
+    if (writerHandle && head + 1 - ringTail >= PAGE_RECORDS)
+    {
+        xTaskNotifyGive(writerHandle);
+    }
+    return true;
+}
+
+void tapLogReport(Print &out)
+{
+    uint32_t first, last, count;
+    bool any = scanFiles(first, last, count);
+    out.printf("[LOG] boot %u, %u files", (unsigned)bootId, (unsigned)count);
+    if (any)
+    {
+        out.printf(" (%08u..%08u)", (unsigned)first, (unsigned)last);
+    }
+    out.printf(", written %u, pending %u, dropped %u\n", (unsigned)written,
+               (unsigned)pending(), (unsigned)dropped);
+
+    // Last few flushed records of the active file
+    static constexpr uint32_t SHOW = 8;
+    char path[32];
+    logPath(path, sizeof(path), fileIndex);
+    fs::File f = LittleFS.open(path, FILE_READ);
+    if (!f)
+    {
+        return;
+    }
+    uint32_t n = f.size() / sizeof(TapRecord);
+    f.seek((n > SHOW ? n - SHOW : 0) * sizeof(TapRecord));
+
+    TapRecord r;
+    while (f.read((uint8_t *)&r, sizeof(r)) == sizeof(r))
+    {
+        out.printf("  boot %5u %10u ms %s ", (unsigned)r.bootId, (unsigned)r.uptimeMs,
+                   recordValid(r) ? (r.result == 0 ? "granted" : "denied ") : "corrupt");
+        for (uint8_t i = 0; i < r.uidLength && i < sizeof(r.uid); i++)
+        {
+            out.printf("%02X", r.uid[i]);
+        }
+        out.println();
+    }
+    f.close();
+}
+
+#endif // TAP_LOG
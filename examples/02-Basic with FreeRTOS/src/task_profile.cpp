@@ -0,0 +1,134 @@
+/**************************************************************************/
+/*!
+    @file     task_profile.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Task profile tables and stack high-water-mark report.
+*/
+/**************************************************************************/
+
+#include "task_profile.h"
+
+// Core 0 also runs the IDF system tasks (timers, IPC, idle), core 1 runs
+// loop() at priority 1. On the S3 both stack sizes and high-water marks
+// are in bytes.
+#if TASK_PROFILE == 2
+// Pipeline: core 0 acquires (RF, card crypto) and logs, core 1 decides and
+// renders (authorization, LEDs, audio). RF -> authorization and
+// authorization -> log are lock-free rings: a scan never waits for a
+// decision, a frame or the flash.
+static const char PROFILE_NAME[] = "pipeline";
+static constexpr TaskProfile PROFILES[TASK_COUNT] = {
+    {"LEDState", 1, 4, 4096, 0},
+    {"NFC", 0, 5, 4096, 40},
+    {"Audio", 1, 5, 8192, 2},
+    {"TapLog", 0, 1, 3072, TAP_LOG_FLUSH_MS},
+    {"SdRead", 1, 2, 4096, 0},
+    {"Metrics", 0, 1, 4096, METRICS_PERIOD_MS},
+    {"Auth", 1, 3, 4096, 0},
+};
+#elif TASK_PROFILE == 1
+// Latency: NFC alone on core 1 above everything else, so the read after
+// the IRQ edge never waits for an LED frame or an audio service pass.
+// SD read-ahead spins on SPI for a whole chunk: below LED on core 0.
+static const char PROFILE_NAME[] = "latency";
+static constexpr TaskProfile PROFILES[TASK_COUNT] = {
+    {"LEDState", 0, 2, 4096, 0},
+    {"NFC", 1, 6, 4096, 40},
+    {"Audio", 0, 5, 8192, 2},
+    {"TapLog", 0, 1, 3072, TAP_LOG_FLUSH_MS},
+    {"SdRead", 0, 1, 4096, 0},
+    {"Metrics", 0, 1, 4096, METRICS_PERIOD_MS},
+    {"Auth", 0, 3, 4096, 0},
+};
+#else
+// Balanced: LED and NFC share core 0, audio has core 1 to itself (SD
+// read-ahead just below it, preempted by every audio service pass)
+static const char PROFILE_NAME[] = "balanced";
+static constexpr TaskProfile PROFILES[TASK_COUNT] = {
+    {"LEDState", 0, 2, 4096, 0},
+    {"NFC", 0, 2, 4096, 40},
+    {"Audio", 1, 5, 8192, 2},
+    {"TapLog", 0, 1, 3072, TAP_LOG_FLUSH_MS},
+    {"SdRead", 1, 4, 4096, 0},
+    {"Metrics", 0, 1, 4096, METRICS_PERIOD_MS},
+    {"Auth", 1, 4, 4096, 0},
+};
+#endif
+
+static TaskHandle_t handles[TASK_COUNT] = {};
+
+#if STATIC_ALLOC
+// Every row's stack and TCB in .bss, laid out back to back at link time
+static constexpr uint32_t stackOffset(uint8_t id)
+{
+    return id == 0 ? 0 : stackOffset(id - 1) + PROFILES[id - 1].stackBytes;
+}
+alignas(16) static StackType_t stacks[stackOffset(TASK_COUNT) / sizeof(StackType_t)];
+static StaticTask_t tcbs[TASK_COUNT];
+
+struct TaskEntry
+{
+    TaskFunction_t fn;
+    TaskHandle_t *handle;
+};
+static TaskEntry entries[TASK_COUNT] = {};
+
+// The static create only returns the handle once the task exists and may
+// already have run: publish it from the task itself before its body starts
+static void taskEntry(void *param)
+{
+    const TaskEntry &e = entries[(uintptr_t)param];
+    *e.handle = xTaskGetCurrentTaskHandle();
+    e.fn(nullptr);
+}
+#endif
+
+const TaskProfile &taskProfile(TaskId id)
+{
+    return PROFILES[id];
+}
+
+bool taskStart(TaskId id, TaskFunction_t fn, TaskHandle_t *handle)
+{
+    // Created straight into the caller's handle: it is set before the task
+    // first runs, which ISRs notifying that task rely on
+    const TaskProfile &p = PROFILES[id];
+    TaskHandle_t *out = handle ? handle : &handles[id];
+#if STATIC_ALLOC
+    entries[id] = {fn, out};
+    *out = xTaskCreateStaticPinnedToCore(taskEntry, p.name, p.stackBytes, (void *)(uintptr_t)id,
+                                         p.priority, &stacks[stackOffset(id) / sizeof(StackType_t)],
+                                         &tcbs[id], p.core);
+    BaseType_t ok = *out ? pdPASS : pdFAIL;
+#else
+    BaseType_t ok = xTaskCreatePinnedToCore(fn, p.name, p.stackBytes, nullptr,
+                                            p.priority, out, p.core);
+#endif
+    if (ok != pdPASS)
+    {
+        Serial.print(F("[TASK] Could not start "));
+        Serial.println(p.name);
+        *out = nullptr;
+    }
+    handles[id] = *out;
+    return ok == pdPASS;
+}
+
+void taskReport(Print &out)
+{
+    out.printf("[TASK] profile %s: name  core  prio  stack  min_free\n", PROFILE_NAME);
+    for (uint8_t i = 0; i < TASK_COUNT; i++)
+    {
+        const TaskProfile &p = PROFILES[i];
+        if (!handles[i])
+        {
+            out.printf("  %-10s not running\n", p.name);
+            continue;
+        }
+        out.printf("  %-10s %4d %5u %6u %9u\n", p.name, (int)p.core,
+                   (unsigned)p.priority, (unsigned)p.stackBytes,
+                   (unsigned)uxTaskGetStackHighWaterMark(handles[i]));
+    }
+    out.printf("  heap free %u, min %u\n", (unsigned)esp_get_free_heap_size(),
+               (unsigned)esp_get_minimum_free_heap_size());
+}
@@ -0,0 +1,46 @@
+/**************************************************************************/
+/*!
+    @file     uid_cache.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Time-bounded UID de-duplication.
+*/
+/**************************************************************************/
+
+#include "uid_cache.h"
+
+bool UidCache::accept(const uint8_t *uid, uint8_t uidLength, uint32_t nowMs)
+{
+    if (uidLength == 0 || uidLength > sizeof(entries[0].uid))
+    {
+        return false;
+    }
+
+    Entry *oldest = &entries[0];
+    for (uint8_t i = 0; i < SLOTS; i++)
+    {
+        Entry &e = entries[i];
+        if (e.length == uidLength && memcmp(e.uid, uid, uidLength) == 0)
+        {
+            bool fresh = (nowMs - e.lastSeenMs) >= windowMs;
+            e.lastSeenMs = nowMs;
+            return fresh;
+        }
+
+        // Free slots first, then the least recently seen one
+        if (oldest->length != 0 &&
+            (e.length == 0 || (nowMs - e.lastSeenMs) > (nowMs - oldest->lastSeenMs)))
+        {
+            oldest = &e;
+        }
+    }
+
+    memcpy(oldest->uid, uid, uidLength);
+    oldest->length = uidLength;
+    oldest->lastSeenMs = nowMs;
+    return true;
+}
+
+void UidCache::clear()
+{
+    memset(entries, 0, sizeof(entries));
+}
@@ -0,0 +1,144 @@
+/**************************************************************************/
+/*!
+    @file     test_ndef.cpp
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Host tests of the NDEF parser (pio test -e test).
+              Card memory is untrusted: truncated, oversized and wrapping
+              length fields must be rejected, never read past `len`.
+*/
+/**************************************************************************/
+
+#include <unity.h>
+#include "card_record.h"
+
+static CardRecord rec;
+
+void setUp()
+{
+    memset(&rec, 0xAA, sizeof(rec));
+}
+
+void tearDown() {}
+
+// ======================= WELL-FORMED ==========================
+static void test_short_text_record()
+{
+    // MB ME SR TNF=1, type 'T', payload: lang "en" + "hi"
+    const uint8_t msg[] = {0xD1, 0x01, 0x05, 'T', 0x02, 'e', 'n', 'h', 'i'};
+    TEST_ASSERT_TRUE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+    TEST_ASSERT_EQUAL(CARD_DATA_NDEF_TEXT, rec.kind);
+    TEST_ASSERT_EQUAL(2, rec.length);
+    TEST_ASSERT_EQUAL_MEMORY("hi", rec.data, 2);
+}
+
+static void test_short_uri_record()
+{
+    // Prefix code 4 -> "https://"
+    const uint8_t msg[] = {0xD1, 0x01, 0x04, 'U', 0x04, 'a', '.', 'b'};
+    TEST_ASSERT_TRUE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+    TEST_ASSERT_EQUAL(CARD_DATA_NDEF_URI, rec.kind);
+    TEST_ASSERT_EQUAL(11, rec.length);
+    TEST_ASSERT_EQUAL_MEMORY("https://a.b", rec.data, 11);
+}
+
+static void test_long_record_with_id()
+{
+    // MB ME IL TNF=2 (SR clear), type "x", id "i", payload "pq"
+    const uint8_t msg[] = {0xCA, 0x01, 0x00, 0x00, 0x00, 0x02, 0x01, 'x', 'i', 'p', 'q'};
+    TEST_ASSERT_TRUE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+    TEST_ASSERT_EQUAL(CARD_DATA_NDEF_OTHER, rec.kind);
+    TEST_ASSERT_EQUAL(2, rec.length);
+    TEST_ASSERT_EQUAL_MEMORY("pq", rec.data, 2);
+}
+
+static void test_payload_capped_at_record_max()
+{
+    uint8_t msg[3 + 1 + 100];
+    msg[0] = 0xD2; // SR, TNF=2
+    msg[1] = 0x01;
+    msg[2] = 100;
+    memset(&msg[3], 'z', sizeof(msg) - 3);
+    TEST_ASSERT_TRUE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+    TEST_ASSERT_EQUAL(CARD_RECORD_MAX, rec.length);
+}
+
+// ======================= TRUNCATED ==========================
+static void test_truncated_header()
+{
+    const uint8_t msg[] = {0xD1, 0x01};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_truncated_long_length()
+{
+    // SR clear: 4 length bytes expected, 2 present
+    const uint8_t msg[] = {0xC1, 0x01, 0x00, 0x00};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_truncated_id_length()
+{
+    // IL set, message ends where the id length should be
+    const uint8_t msg[] = {0xD9, 0x01, 0x00};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+// ======================= OVERSIZED ==========================
+static void test_payload_past_end()
+{
+    const uint8_t msg[] = {0xD1, 0x01, 0x10, 'T', 0x02, 'e', 'n'};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_type_and_id_past_end()
+{
+    // Type length 200 and id length 200, payload 0
+    const uint8_t msg[] = {0xD9, 0xC8, 0x00, 0xC8, 'x'};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_text_language_past_payload()
+{
+    const uint8_t msg[] = {0xD1, 0x01, 0x02, 'T', 0x3F, 'e'};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+// ======================= WRAPPING ==========================
+static void test_wrapping_payload_length()
+{
+    // p + typeLen + payloadLen wraps to 6 in 32 bits: fits the message
+    // if the lengths are added up instead of checked one by one
+    const uint8_t msg[] = {0xC1, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 'T', 0x02, 'e', 'n'};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_wrapping_payload_length_uri()
+{
+    const uint8_t msg[] = {0xC1, 0x01, 0xFF, 0xFF, 0xFF, 0xFA, 'U', 0x00};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+static void test_huge_payload_length()
+{
+    const uint8_t msg[] = {0xC2, 0x01, 0x80, 0x00, 0x00, 0x00, 'x', 'p'};
+    TEST_ASSERT_FALSE(ndefParseFirstRecord(msg, sizeof(msg), rec));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_short_text_record);
+    RUN_TEST(test_short_uri_record);
+    RUN_TEST(test_long_record_with_id);
+    RUN_TEST(test_payload_capped_at_record_max);
+    RUN_TEST(test_truncated_header);
+    RUN_TEST(test_truncated_long_length);
+    RUN_TEST(test_truncated_id_length);
+    RUN_TEST(test_payload_past_end);
+    RUN_TEST(test_type_and_id_past_end);
+    RUN_TEST(test_text_language_past_payload);
+    RUN_TEST(test_wrapping_payload_length);
+    RUN_TEST(test_wrapping_payload_length_uri);
+    RUN_TEST(test_huge_payload_length);
+    return UNITY_END();
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Build a feedback timeline file for the reader (FEEDBACK_TIMELINE_PATH).
+
+Input: JSON with an idle chaser step and one keyframe list per track:
+
+    {
+      "idle_step_ms": 120,
+      "detected": [{"color": "FFFF00", "brightness": 2, "ms": 0},
+                   {"color": "FFFF00", "brightness": 65, "ms": 100, "fade": true}],
+      "granted":  [{"color": "00FF00", "brightness": 65, "ms": 200, "cue": "granted"}],
+      "denied":   [{"color": "FF0000", "brightness": 65, "ms": 300, "cue": "denied"}]
+    }
+
+Keyframe keys: color (RRGGBB), brightness (0-255, capped at MAX_BRIGHTNESS
+on the reader), ms (0-65535), optional cue (granted / denied / expired /
+error), fade (gamma fade from the previous keyframe's brightness, 0 for
+the first of a track) and wait_audio (hold until the cue ends, ms is the
+fallback when it can't play).
+
+    python tools/build_timeline.py tools/express.json feedback.tl
+
+Copy feedback.tl to the root of the SD card: it is installed on LittleFS
+at the next boot. Layout must match include/feedback_timeline.h.
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = 0x4C544246  # "FBTL"
+VERSION = 1
+MAX_KEYFRAMES = 32  # FEEDBACK_MAX_KEYFRAMES
+NO_CUE = 0xFF
+KF_FADE = 0x01
+KF_WAIT_AUDIO = 0x02
+TRACKS = ("detected", "granted", "denied")
+CUES = {"granted": 0, "denied": 1, "expired": 2, "error": 3}  # SoundId
+
+
+def keyframe(k):
+    rgb = bytes.fromhex(k["color"])
+    if len(rgb) != 3:
+        sys.exit("bad color: %s" % k["color"])
+    ms = int(k["ms"])
+    brightness = int(k["brightness"])
+    if not 0 <= ms <= 0xFFFF or not 0 <= brightness <= 255:
+        sys.exit("out of range: %s" % k)
+    cue = CUES[k["cue"]] if "cue" in k else NO_CUE
+    flags = (KF_FADE if k.get("fade") else 0) | (KF_WAIT_AUDIO if k.get("wait_audio") else 0)
+    if flags & KF_WAIT_AUDIO and cue == NO_CUE:
+        sys.exit("wait_audio needs a cue: %s" % k)
+    return rgb + struct.pack("<BBBH", brightness, cue, flags, ms)
+
+
+def main(src, dst):
+    with open(src) as f:
+        spec = json.load(f)
+
+    tracks = [[keyframe(k) for k in spec.get(name, [])] for name in TRACKS]
+    count = sum(len(t) for t in tracks)
+    if count > MAX_KEYFRAMES:
+        sys.exit("%d keyframes, the reader holds %d" % (count, MAX_KEYFRAMES))
+    idle = int(spec.get("idle_step_ms", 120))
+    if not 1 <= idle <= 0xFFFF:
+        sys.exit("bad idle_step_ms: %d" % idle)
+
+    with open(dst, "wb") as f:
+        f.write(struct.pack("<IB3BHH", MAGIC, VERSION, *[len(t) for t in tracks], idle, 0))
+        for t in tracks:
+            f.write(b"".join(t))
+
+    total = [sum(struct.unpack_from("<H", k, 6)[0] for k in t) for t in tracks]
+    print("%d keyframes: detected %d ms, granted %d ms, denied %d ms" % (count, *total))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+"""Build the allowlist image for the "uidlist" flash partition.
+
+Input: text file, one UID per line as hex ("04A1B2C3" or "04:A1:B2:C3:D4:E5:F6").
+Blank lines and lines starting with '#' are ignored.
+
+    python tools/build_uidlist.py cards.txt uidlist.bin
+    esptool.py --chip esp32s3 write_flash 0x310000 uidlist.bin
+
+Layout and hash must match include/allowlist.h / src/allowlist.cpp.
+"""
+
+import struct
+import sys
+
+MAGIC = 0x4C444955  # "UIDL"
+VERSION = 1
+SLOT_SIZE = 8
+PARTITION_SIZE = 0x200000
+MAX_LOAD = 0.5
+
+
+def uid_hash(uid):
+    h = 2166136261
+    for b in bytes([len(uid)]) + uid:
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def main(src, dst):
+    uids = set()
+    with open(src) as f:
+        for line in f:
+            line = line.strip()
+            if not line or line.startswith("#"):
+                continue
+            uid = bytes.fromhex(line.replace(":", "").replace(" ", ""))
+            if not 1 <= len(uid) < SLOT_SIZE:
+                sys.exit("bad UID length: %s" % line)
+            uids.add(uid)
+
+    slots = 1
+    while slots * MAX_LOAD < max(len(uids), 1):
+        slots *= 2
+
+    size = 16 + slots * SLOT_SIZE
+    if size > PARTITION_SIZE:
+        sys.exit("%d UIDs need %d bytes, partition holds %d" % (len(uids), size, PARTITION_SIZE))
+
+    table = bytearray(slots * SLOT_SIZE)
+    for uid in sorted(uids):
+        i = uid_hash(uid) & (slots - 1)
+        while table[i * SLOT_SIZE] != 0:
+            i = (i + 1) & (slots - 1)
+        table[i * SLOT_SIZE:(i + 1) * SLOT_SIZE] = bytes([len(uid)]) + uid.ljust(SLOT_SIZE - 1, b"\0")
+
+    with open(dst, "wb") as f:
+        f.write(struct.pack("<IHHII", MAGIC, VERSION, SLOT_SIZE, slots, len(uids)))
+        f.write(table)
+
+    print("%d UIDs, %d slots, %d bytes" % (len(uids), slots, size))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    main(sys.argv[1], sys.argv[2])
@@ -0,0 +1,220 @@
+/**************************************************************************/
+/*!
+    @file     led_effects.h
+    @author   Ivan Hermida - HermitX SLU
+    @brief    Compile-time LED effect engine shared by the examples.
+              - Every effect is a template on LED count, colour and timing;
+                its frames are built by a constexpr constructor, so a
+                `static constexpr` effect lives in flash as a table
+              - at(elapsedMs) is a table lookup: it returns the frame to
+                show (RGB bytes ready to memcpy), its brightness and how
+                long it stays valid
+              - A new effect only needs the same at() signature
+*/
+/**************************************************************************/
+
+#ifndef LED_EFFECTS_H
+#define LED_EFFECTS_H
+
+#include <stdint.h>
+
+namespace fx
+{
+
+// ======================= FRAME ==========================
+struct Frame
+{
+    const uint8_t *rgb;  // N * 3 bytes, CRGB layout
+    uint8_t brightness;  // global brightness for this frame
+    uint32_t holdMs;     // until the next frame; 0 -> effect finished
+};
+
+static constexpr uint32_t HOLD_FOREVER = 0xFFFFFFFFu;
+
+// ======================= CONSTEXPR MATH ==========================
+namespace detail
+{
+
+static constexpr double LN2 = 0.693147180559945309;
+
+// ln(x), x > 0: scale into [0.5, 1), then 2 * atanh((x - 1) / (x + 1))
+constexpr double ln(double x)
+{
+    int k = 0;
+    while (x >= 1.0)
+    {
+        x *= 0.5;
+        k++;
+    }
+    while (x < 0.5)
+    {
+        x *= 2.0;
+        k--;
+    }
+    double z = (x - 1.0) / (x + 1.0);
+    double z2 = z * z;
+    double term = z;
+    double sum = 0.0;
+    for (int n = 1; n < 40; n += 2)
+    {
+        sum += term / n;
+        term *= z2;
+    }
+    return 2.0 * sum + k * LN2;
+}
+
+// e^x: halve until small, Taylor series, square back
+constexpr double exp(double x)
+{
+    int halvings = 0;
+    while (x > 0.5 || x < -0.5)
+    {
+        x *= 0.5;
+        halvings++;
+    }
+    double sum = 1.0;
+    double term = 1.0;
+    for (int n = 1; n < 16; n++)
+    {
+        term *= x / n;
+        sum += term;
+    }
+    while (halvings-- > 0)
+    {
+        sum *= sum;
+    }
+    return sum;
+}
+
+// x^g for x in [0, 1]
+constexpr double powUnit(double x, double g)
+{
+    return x <= 0.0 ? 0.0 : (x >= 1.0 ? 1.0 : exp(g * ln(x)));
+}
+
+// FastLED scale8 (FASTLED_SCALE8_FIXED): (v * (1 + s)) >> 8
+constexpr uint8_t scale8(uint8_t v, uint8_t s)
+{
+    return (uint8_t)(((uint16_t)v * (uint16_t)(1 + s)) >> 8);
+}
+
+constexpr uint8_t channel(uint32_t rgb, uint8_t c)
+{
+    return (uint8_t)(rgb >> (16 - 8 * c));
+}
+
+} // namespace detail
+
+// ======================= BRIGHTNESS CURVE ==========================
+// Steps levels from From to To along t^(Gamma10 / 10), t = 0..1
+template <uint16_t Steps, uint8_t From, uint8_t To, uint8_t Gamma10 = 22>
+struct BrightnessCurve
+{
+    static_assert(Steps >= 2, "a curve needs at least two steps");
+
+    uint8_t level[Steps];
+
+    constexpr BrightnessCurve() : level{}
+    {
+        for (uint16_t i = 0; i < Steps; i++)
+        {
+            double t = detail::powUnit((double)i / (Steps - 1), Gamma10 / 10.0);
+            level[i] = (uint8_t)(From + ((int)To - (int)From) * t + (To >= From ? 0.5 : -0.5));
+        }
+    }
+};
+
+// ======================= EFFECTS ==========================
+// Bouncing chaser: one LED in Color, the rest in Color scaled by Dim.
+// Positions 0, 1 .. N-1, N-2 .. 1, then again, one per StepMs.
+template <uint8_t N, uint32_t Color, uint8_t Dim, uint16_t StepMs, uint8_t Brightness>
+class Chaser
+{
+public:
+    static constexpr uint16_t FRAMES = N > 1 ? 2 * (N - 1) : 1;
+
+    constexpr Chaser() : rgb{}
+    {
+        for (uint16_t f = 0; f < FRAMES; f++)
+        {
+            uint8_t active = f < N ? f : (uint8_t)(FRAMES - f);
+            for (uint8_t i = 0; i < N; i++)
+            {
+                for (uint8_t c = 0; c < 3; c++)
+                {
+                    uint8_t full = detail::channel(Color, c);
+                    rgb[f][i * 3 + c] = i == active ? full : detail::scale8(full, Dim);
+                }
+            }
+        }
+    }
+
+    Frame at(uint32_t elapsedMs) const
+    {
+        uint32_t step = elapsedMs / StepMs;
+        return {rgb[step % FRAMES], Brightness, StepMs - elapsedMs % StepMs};
+    }
+
+private:
+    uint8_t rgb[FRAMES][N * 3];
+};
+
+// Solid Color whose brightness follows a gamma curve from From to To over
+// DurationMs, one level per FrameMs. Finished (holdMs 0) after DurationMs.
+template <uint8_t N, uint32_t Color, uint16_t DurationMs, uint16_t FrameMs,
+          uint8_t From, uint8_t To, uint8_t Gamma10 = 22>
+class Ramp
+{
+public:
+    static constexpr uint16_t STEPS = DurationMs / FrameMs + 1;
+
+    constexpr Ramp() : rgb{}, curve()
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                rgb[i * 3 + c] = detail::channel(Color, c);
+            }
+        }
+    }
+
+    Frame at(uint32_t elapsedMs) const
+    {
+        if (elapsedMs > DurationMs)
+        {
+            return {rgb, To, 0};
+        }
+        return {rgb, curve.level[elapsedMs / FrameMs], FrameMs - elapsedMs % FrameMs};
+    }
+
+private:
+    uint8_t rgb[N * 3];
+    BrightnessCurve<STEPS, From, To, Gamma10> curve;
+};
+
+// Constant colour, never finishes
+template <uint8_t N, uint32_t Color, uint8_t Brightness>
+class Solid
+{
+public:
+    constexpr Solid() : rgb{}
+    {
+        for (uint8_t i = 0; i < N; i++)
+        {
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                rgb[i * 3 + c] = detail::channel(Color, c);
+            }
+        }
+    }
+
+    Frame at(uint32_t) const { return {rgb, Brightness, HOLD_FOREVER}; }
+
+private:
+    uint8_t rgb[N * 3];
+};
+
+} // namespace fx
+
+#endif // LED_EFFECTS_H